@@ -120,27 +120,23 @@ static int is_enemy_piece(const GameState *game, int player, int r, int c) {
 
 /* Check if 'player' has a move attacking (r,c). Used for check detection. */
 static int attacks_square(const GameState *game, int player, int r, int c) {
-    /* Pawn attacks */
-    int dir = (player == WHITE) ? -1 : 1;
-    /* White pawns move up (decreasing row), Black down */
+    /* Pawn attacks: White pawns move up (decreasing row), so they attack from below */
+    int dir = (player == WHITE) ? 1 : -1;
+    char pawn = (player == WHITE) ? 'P' : 'p';
     int pawnRow = r + dir;
-    if(on_board(pawnRow, c-1) && ((player == WHITE && game->board[pawnRow][c-1] == 'p') ||
-                                 (player == BLACK && game->board[pawnRow][c-1] == 'P')))
+    if(on_board(pawnRow, c-1) && game->board[pawnRow][c-1] == pawn)
         return 1;
-    if(on_board(pawnRow, c+1) && ((player == WHITE && game->board[pawnRow][c+1] == 'p') ||
-                                 (player == BLACK && game->board[pawnRow][c+1] == 'P')))
+    if(on_board(pawnRow, c+1) && game->board[pawnRow][c+1] == pawn)
         return 1;
     /* Knight attacks */
+    char knight = (player == WHITE) ? 'N' : 'n';
     for(int k = 0; k < 8; k++) {
         int nr = r + knight_moves[k][0];
         int nc = c + knight_moves[k][1];
-        if(on_board(nr, nc)) {
-            char pc = game->board[nr][nc];
-            if((player == WHITE && pc == 'n') || (player == BLACK && pc == 'N'))
-                return 1;
-        }
+        if(on_board(nr, nc) && game->board[nr][nc] == knight)
+            return 1;
     }
-    /* Rook/Queen straight-line attacks */
+    /* Rook/Queen straight-line and Bishop/Queen diagonal attacks */
     int dirs[8][2] = {{1,0},{-1,0},{0,1},{0,-1},{1,1},{1,-1},{-1,1},{-1,-1}};
     for(int d = 0; d < 8; d++) {
         int dr = dirs[d][0], dc = dirs[d][1];
@@ -148,17 +144,11 @@ static int attacks_square(const GameState *game, int player, int r, int c) {
         while(on_board(nr, nc)) {
             char pc = game->board[nr][nc];
             if(pc != '.') {
-                /* If same player piece, block */
-                if(is_own_piece(game, 1-player, nr, nc)) break;
-                /* Check if enemy rook/queen (straight) or bishop/queen (diagonal) */
-                if(d < 4) { /* straight dirs (0-3) */
-                    if((player==WHITE && (pc=='r' || pc=='q')) ||
-                       (player==BLACK && (pc=='R' || pc=='Q')))
-                        return 1;
-                } else { /* diagonal dirs (4-7) */
-                    if((player==WHITE && (pc=='b' || pc=='q')) ||
-                       (player==BLACK && (pc=='B' || pc=='Q')))
-                        return 1;
+                /* First piece on the ray either attacks or blocks */
+                if(is_own_piece(game, player, nr, nc)) {
+                    char t = pc | 0x20;  /* lowercase piece type */
+                    if(d < 4 && (t == 'r' || t == 'q')) return 1;   /* straight dirs (0-3) */
+                    if(d >= 4 && (t == 'b' || t == 'q')) return 1;  /* diagonal dirs (4-7) */
                 }
                 break;
             }
@@ -166,15 +156,13 @@ static int attacks_square(const GameState *game, int player, int r, int c) {
         }
     }
     /* King adjacency (should not happen in legal games) */
+    char king = (player == WHITE) ? 'K' : 'k';
     for(int dr = -1; dr <= 1; dr++) {
         for(int dc = -1; dc <= 1; dc++) {
             if(dr==0 && dc==0) continue;
             int nr = r + dr, nc = c + dc;
-            if(on_board(nr,nc)) {
-                char pc = game->board[nr][nc];
-                if((player==WHITE && pc=='k') || (player==BLACK && pc=='K'))
-                    return 1;
-            }
+            if(on_board(nr,nc) && game->board[nr][nc] == king)
+                return 1;
         }
     }
     return 0;
@@ -450,3 +438,196 @@ int has_valid_moves(GameState *game, int player) {
     }
     return 0;
 }
+
+/* Load a position from FEN. Castling flags follow make_move: 1 = lost. */
+int load_fen(GameState *game, const char *fen) {
+    int r = 0, c = 0;
+    const char *p = fen;
+    while(*p == ' ') p++;
+    for(; *p && *p != ' '; p++) {
+        if(*p == '/') {
+            if(c != BOARD_SIZE) return 0;
+            r++; c = 0;
+        } else if(*p >= '1' && *p <= '8') {
+            for(int n = *p - '0'; n > 0; n--) {
+                if(r >= BOARD_SIZE || c >= BOARD_SIZE) return 0;
+                game->board[r][c++] = '.';
+            }
+        } else if(strchr("PNBRQKpnbrqk", *p)) {
+            if(r >= BOARD_SIZE || c >= BOARD_SIZE) return 0;
+            game->board[r][c++] = *p;
+        } else return 0;
+    }
+    if(r != BOARD_SIZE - 1 || c != BOARD_SIZE) return 0;
+
+    /* Side to move */
+    while(*p == ' ') p++;
+    if(*p == 'w') game->turn = WHITE;
+    else if(*p == 'b') game->turn = BLACK;
+    else return 0;
+    p++;
+
+    /* Castling rights */
+    while(*p == ' ') p++;
+    game->whiteRookH = game->whiteRookAmoved = 1;
+    game->blackRookH = game->blackRookAmoved = 1;
+    for(; *p && *p != ' '; p++) {
+        switch(*p) {
+            case 'K': game->whiteRookH = 0; break;
+            case 'Q': game->whiteRookAmoved = 0; break;
+            case 'k': game->blackRookH = 0; break;
+            case 'q': game->blackRookAmoved = 0; break;
+            case '-': break;
+            default: return 0;
+        }
+    }
+    game->whiteKingMoved = game->board[7][4] != 'K' ||
+                           (game->whiteRookH && game->whiteRookAmoved);
+    game->blackKingMoved = game->board[0][4] != 'k' ||
+                           (game->blackRookH && game->blackRookAmoved);
+
+    /* En passant target (optional) */
+    game->ep_row = game->ep_col = -1;
+    while(*p == ' ') p++;
+    if(*p >= 'a' && *p <= 'h' && p[1] >= '1' && p[1] <= '8') {
+        game->ep_col = p[0] - 'a';
+        game->ep_row = BOARD_SIZE - (p[1] - '0');
+    }
+    return 1;
+}
+
+/* Keep the move if make_move accepts it and it does not leave the king in check */
+static int try_add_move(const GameState *game, int sr, int sc, int dr, int dc,
+                        Move *moves, int n) {
+    GameState temp;
+    if(n >= MAX_MOVES || !on_board(dr, dc)) return n;
+    if(is_own_piece(game, game->turn, dr, dc)) return n;
+    copy_game(game, &temp);
+    if(!make_move(&temp, sr, sc, dr, dc)) return n;
+    if(is_in_check(&temp, game->turn)) return n;
+    moves[n].src_row = sr; moves[n].src_col = sc;
+    moves[n].dst_row = dr; moves[n].dst_col = dc;
+    return n + 1;
+}
+
+/* Generate candidate destinations per piece type and let make_move validate them */
+int generate_moves(const GameState *game, Move *moves) {
+    static const int dirs[8][2] = {{1,0},{-1,0},{0,1},{0,-1},{1,1},{1,-1},{-1,1},{-1,-1}};
+    int player = game->turn;
+    int n = 0;
+    for(int r=0; r<BOARD_SIZE; r++) {
+        for(int c=0; c<BOARD_SIZE; c++) {
+            if(!is_own_piece(game, player, r, c)) continue;
+            char pc = game->board[r][c];
+            switch(pc) {
+                case 'P': case 'p': {
+                    int dir = (pc == 'P') ? -1 : 1;
+                    n = try_add_move(game, r, c, r+dir, c, moves, n);
+                    n = try_add_move(game, r, c, r+2*dir, c, moves, n);
+                    n = try_add_move(game, r, c, r+dir, c-1, moves, n);
+                    n = try_add_move(game, r, c, r+dir, c+1, moves, n);
+                    break;
+                }
+                case 'N': case 'n':
+                    for(int k=0; k<8; k++)
+                        n = try_add_move(game, r, c, r+knight_moves[k][0], c+knight_moves[k][1], moves, n);
+                    break;
+                case 'K': case 'k':
+                    for(int d=0; d<8; d++)
+                        n = try_add_move(game, r, c, r+dirs[d][0], c+dirs[d][1], moves, n);
+                    n = try_add_move(game, r, c, r, c+2, moves, n);
+                    n = try_add_move(game, r, c, r, c-2, moves, n);
+                    break;
+                default: {
+                    /* Sliders: rook uses dirs 0-3, bishop 4-7, queen all */
+                    int lo = (pc=='B' || pc=='b') ? 4 : 0;
+                    int hi = (pc=='R' || pc=='r') ? 4 : 8;
+                    for(int d=lo; d<hi; d++) {
+                        int nr = r + dirs[d][0], nc = c + dirs[d][1];
+                        while(on_board(nr, nc) && !is_own_piece(game, player, nr, nc)) {
+                            n = try_add_move(game, r, c, nr, nc, moves, n);
+                            if(game->board[nr][nc] != '.') break;
+                            nr += dirs[d][0]; nc += dirs[d][1];
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+/* Write a move in coordinate notation */
+void format_move(Move m, char *out) {
+    out[0] = 'a' + m.src_col;
+    out[1] = '0' + (BOARD_SIZE - m.src_row);
+    out[2] = 'a' + m.dst_col;
+    out[3] = '0' + (BOARD_SIZE - m.dst_row);
+    out[4] = '\0';
+}
+
+unsigned short move_pack(Move m) {
+    return (unsigned short)(((m.src_row * 8 + m.src_col) << 6) | (m.dst_row * 8 + m.dst_col));
+}
+
+Move move_unpack(unsigned short v) {
+    Move m;
+    m.src_row = (v >> 9) & 7; m.src_col = (v >> 6) & 7;
+    m.dst_row = (v >> 3) & 7; m.dst_col = v & 7;
+    return m;
+}
+
+/* Zobrist keys are derived on the fly (splitmix64) so no table needs initializing */
+static unsigned long long zobrist_key(unsigned long long k) {
+    unsigned long long z = (k + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* Whether a pawn of the side to move stands next to the pawn that just
+   made a double step. Only then does the en passant square change the
+   position; otherwise transpositions and FENs written with "-" would
+   hash apart. */
+static int ep_capturable(const GameState *game) {
+    if(game->ep_col < 0) return 0;
+    int row = game->ep_row + (game->turn == WHITE ? 1 : -1);   /* the pushed pawn */
+    char pawn = (game->turn == WHITE) ? 'P' : 'p';
+    if(!on_board(row, game->ep_col)) return 0;
+    return (game->ep_col > 0 && game->board[row][game->ep_col - 1] == pawn) ||
+           (game->ep_col < BOARD_SIZE - 1 && game->board[row][game->ep_col + 1] == pawn);
+}
+
+/* Whether a castling right still counts. make_move leaves the right set
+   when the rook is captured on its home square, but a FEN of the same
+   position drops it, so check that the king and rook are still home. */
+static int castle_right(const GameState *game, int king_moved, int rook_moved,
+                        int row, int col) {
+    char king = (row == 7) ? 'K' : 'k';
+    char rook = (row == 7) ? 'R' : 'r';
+    return !king_moved && !rook_moved &&
+           game->board[row][4] == king && game->board[row][col] == rook;
+}
+
+/* Hash the position for transposition tables and position indexes */
+unsigned long long position_hash(const GameState *game) {
+    static const char pieces[] = "PNBRQKpnbrqk";
+    unsigned long long h = 0;
+    for(int r=0; r<BOARD_SIZE; r++) {
+        for(int c=0; c<BOARD_SIZE; c++) {
+            char pc = game->board[r][c];
+            if(pc == '.') continue;
+            const char *p = strchr(pieces, pc);
+            if(p) h ^= zobrist_key((unsigned long long)(p - pieces) * 64 + r * 8 + c);
+        }
+    }
+    /* Extra keys start after the 12*64 piece-square keys */
+    if(game->turn == BLACK) h ^= zobrist_key(768);
+    if(castle_right(game, game->whiteKingMoved, game->whiteRookH, 7, 7)) h ^= zobrist_key(769);
+    if(castle_right(game, game->whiteKingMoved, game->whiteRookAmoved, 7, 0)) h ^= zobrist_key(770);
+    if(castle_right(game, game->blackKingMoved, game->blackRookH, 0, 7)) h ^= zobrist_key(771);
+    if(castle_right(game, game->blackKingMoved, game->blackRookAmoved, 0, 0)) h ^= zobrist_key(772);
+    if(ep_capturable(game)) h ^= zobrist_key(773 + game->ep_col);
+    return h;
+}
@@ -15,6 +15,14 @@ typedef struct {
     int ep_row, ep_col;
 } GameState;
 
+/* A move as board indices (0-7), in the same form make_move takes them */
+typedef struct {
+    signed char src_row, src_col, dst_row, dst_col;
+} Move;
+
+/* Upper bound on the number of legal moves in any position */
+#define MAX_MOVES 256
+
 /* Initialize board to starting position */
 void init_board(GameState *game);
 
@@ -38,4 +46,25 @@ int has_valid_moves(GameState *game, int player);
 /* Copy game state (for simulating moves) */
 void copy_game(const GameState *src, GameState *dst);
 
+/* Load a position from a FEN string (board, side, castling, en passant;
+   move counters are ignored). Returns 1 on success, 0 on malformed input. */
+int load_fen(GameState *game, const char *fen);
+
+/* Fill 'moves' with every legal move for the side to move.
+   Returns the number of moves written (at most MAX_MOVES). */
+int generate_moves(const GameState *game, Move *moves);
+
+/* Write a move as "e2e4" into 'out' (at least 5 bytes) */
+void format_move(Move m, char *out);
+
+/* Pack a move into 16 bits (src square << 6 | dst square, squares as
+   row * 8 + col) and back. Used by hash tables and the game database. */
+unsigned short move_pack(Move m);
+Move move_unpack(unsigned short v);
+
+/* 64-bit Zobrist hash of the position (board, side, the castling rights
+   whose king and rook are still home, and the en passant file when a
+   capture there is possible) */
+unsigned long long position_hash(const GameState *game);
+
 #endif /* CHESS_H */
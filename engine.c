@@ -0,0 +1,87 @@
+/* engine.c: Computer opponent with pondering on the opponent's time */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "engine.h"
+
+void engine_init(Engine *e, TransTable *tt, int depth, long long ponder_all_nodes) {
+    memset(e, 0, sizeof(*e));
+    e->tt = tt;
+    e->depth = depth;
+    e->ponder_all_nodes = ponder_all_nodes;
+}
+
+void engine_destroy(Engine *e) {
+    engine_ponder_stop(e);
+}
+
+static void *ponder_thread(void *arg) {
+    Engine *e = arg;
+    SearchLimits limits = { e->depth, 0, &e->stop };
+
+    /* The predicted reply first: a hit can then answer immediately */
+    if (e->has_prediction)
+        search_position(&e->predicted_pos, &limits, e->tt, &e->ponder_result);
+
+    /* Then warm the table for every other reply within the budget */
+    if (e->ponder_all_nodes > 0 && !__atomic_load_n(&e->stop, __ATOMIC_RELAXED)) {
+        Move moves[MAX_MOVES];
+        int n = generate_moves(&e->ponder_root, moves);
+        SearchLimits each = { e->depth, e->ponder_all_nodes / (n ? n : 1), &e->stop };
+        for (int i = 0; i < n && !__atomic_load_n(&e->stop, __ATOMIC_RELAXED); i++) {
+            GameState pos;
+            SearchResult res;
+            copy_game(&e->ponder_root, &pos);
+            make_move(&pos, moves[i].src_row, moves[i].src_col, moves[i].dst_row, moves[i].dst_col);
+            if (e->has_prediction && memcmp(&pos, &e->predicted_pos, sizeof(pos)) == 0) continue;
+            search_position(&pos, &each, e->tt, &res);
+        }
+    }
+    return NULL;
+}
+
+void engine_ponder_start(Engine *e, const GameState *game, const SearchResult *res) {
+    engine_ponder_stop(e);
+    copy_game(game, &e->ponder_root);
+    e->has_prediction = res->has_ponder;
+    if (e->has_prediction) {
+        copy_game(game, &e->predicted_pos);
+        make_move(&e->predicted_pos, res->ponder.src_row, res->ponder.src_col,
+                  res->ponder.dst_row, res->ponder.dst_col);
+    }
+    if (!e->has_prediction && e->ponder_all_nodes <= 0) return;
+    memset(&e->ponder_result, 0, sizeof(e->ponder_result));
+    __atomic_store_n(&e->stop, 0, __ATOMIC_RELAXED);
+    if (pthread_create(&e->thread, NULL, ponder_thread, e) == 0)
+        e->pondering = 1;
+}
+
+void engine_ponder_stop(Engine *e) {
+    if (!e->pondering) return;
+    /* The join orders the ponder thread's results before our reads */
+    __atomic_store_n(&e->stop, 1, __ATOMIC_RELAXED);
+    pthread_join(e->thread, NULL);
+    e->pondering = 0;
+}
+
+int engine_think(Engine *e, const GameState *game, SearchResult *res) {
+    if (e->has_prediction && memcmp(game, &e->predicted_pos, sizeof(*game)) == 0) {
+        e->ponder_hits++;
+        /* A full-depth ponder result is the answer; a partial one still
+           left its iterations in the table, so the search below is short */
+        if (e->ponder_result.depth >= e->depth || (e->ponder_result.has_move &&
+            e->ponder_result.depth > 0 &&
+            (e->ponder_result.score >= MATE_SCORE - MAX_PLY ||
+             e->ponder_result.score <= -MATE_SCORE + MAX_PLY))) {
+            *res = e->ponder_result;
+            e->has_prediction = 0;
+            return res->has_move;
+        }
+    } else if (e->has_prediction) {
+        e->ponder_misses++;
+    }
+    e->has_prediction = 0;
+    SearchLimits limits = { e->depth, 0, NULL };
+    search_position(game, &limits, e->tt, res);
+    return res->has_move;
+}
@@ -0,0 +1,45 @@
+/* engine.h: Computer opponent with pondering on the opponent's time */
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <pthread.h>
+#include "chess.h"
+#include "search.h"
+
+/* One engine per game. While the opponent thinks, a ponder thread searches
+   the position after the predicted reply (and, with a budget, every other
+   reply) into the table shared with the main search. */
+typedef struct {
+    TransTable *tt;             /* shared with the main search and other games */
+    int depth;                  /* search depth for real moves */
+    long long ponder_all_nodes; /* budget for the other replies; 0 = predicted only */
+
+    pthread_t thread;
+    int pondering;              /* ponder thread running */
+    int stop;                   /* set atomically by the I/O path to cancel pondering */
+    GameState ponder_root;      /* opponent to move */
+    GameState predicted_pos;    /* after the predicted reply */
+    int has_prediction;
+    SearchResult ponder_result; /* for predicted_pos, valid after the thread joins */
+
+    int ponder_hits, ponder_misses;
+} Engine;
+
+void engine_init(Engine *e, TransTable *tt, int depth, long long ponder_all_nodes);
+
+/* Stop pondering and release resources */
+void engine_destroy(Engine *e);
+
+/* Pick a move for the side to move, reusing a completed ponder search when
+   the opponent played the predicted reply. Returns 0 if there is no legal
+   move (mate or stalemate). Pondering must have been stopped first. */
+int engine_think(Engine *e, const GameState *game, SearchResult *res);
+
+/* Start pondering on 'game' (opponent to move), predicting res->ponder */
+void engine_ponder_start(Engine *e, const GameState *game, const SearchResult *res);
+
+/* Cancel pondering and wait for the ponder thread. Returns within a few
+   search nodes; safe to call when not pondering. */
+void engine_ponder_stop(Engine *e);
+
+#endif /* ENGINE_H */
@@ -0,0 +1,486 @@
+/* evalserver.c: Batch position-evaluation service over a Unix socket.
+ *
+ * Protocol (text, one line per record, requests may be pipelined):
+ *   request:  BATCH <id> <depth> <nodes> <count>\n  followed by <count> FEN lines
+ *             (depth 0 = no depth limit, nodes 0 = no node budget; a batch
+ *             with neither is answered "<id> error unbounded" and skipped;
+ *             a count above MAX_BATCH is answered "<id> error bad-request"
+ *             and the connection is closed, since its FENs cannot be skipped)
+ *   results:  <id> <index> <score> <bestmove> <depth> <nodes>\n  per position,
+ *             in completion order; "<id> <index> error <reason>" for bad input
+ *   done:     <id> done <count>\n  once every position of the batch is reported
+ *
+ * Each connection has a writer thread, so workers only append results to
+ * its buffer and never wait on a slow client. A connection may have
+ * MAX_INFLIGHT positions queued or with unsent results; beyond that its
+ * reader stops taking requests, leaving the shared queue to the others.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "chess.h"
+#include "search.h"
+#include "nnue.h"
+
+#define DEFAULT_SOCK_PATH "/tmp/chess_eval.sock"
+#define DEFAULT_HASH_MB 64
+#define LINE_SIZE 256
+#define QUEUE_SIZE 4096     /* pending positions across all connections */
+#define MAX_INFLIGHT 256    /* per connection: queued, searching or unsent */
+#define OUT_LIMIT 65536     /* unsent bytes before the reader's own replies wait */
+#define MAX_BATCH 65536     /* positions per request */
+
+/* One client connection; shared by its reader, its writer and by workers
+   posting results */
+typedef struct {
+    int sock;
+    int refs;               /* reader + writer + outstanding jobs */
+    pthread_mutex_t lock;   /* guards everything below */
+    pthread_cond_t out_ready;   /* writer: output posted or reader finished */
+    pthread_cond_t room;        /* reader: in-flight slots or buffer space freed */
+    char *out;              /* posted, not yet taken by the writer */
+    size_t out_len, out_cap;
+    int out_jobs;           /* positions whose results are in 'out' */
+    int inflight;           /* positions queued, searching or in 'out' */
+    int reading;            /* reader still running */
+    int dead;               /* peer gone: results are dropped */
+} Conn;
+
+/* One BATCH request; freed when its last position is reported */
+typedef struct {
+    Conn *conn;
+    char id[64];
+    SearchLimits limits;
+    int count;
+    int remaining;
+} Batch;
+
+/* One position to evaluate */
+typedef struct {
+    Batch *batch;
+    int index;
+    int valid;
+    GameState game;
+} Job;
+
+static Job queue[QUEUE_SIZE];
+static int q_head, q_count;
+static pthread_mutex_t q_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t q_not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t q_not_full = PTHREAD_COND_INITIALIZER;
+
+static TransTable tt;
+
+static void conn_release(Conn *conn) {
+    pthread_mutex_lock(&conn->lock);
+    int refs = --conn->refs;
+    pthread_mutex_unlock(&conn->lock);
+    if (refs == 0) {
+        close(conn->sock);
+        pthread_mutex_destroy(&conn->lock);
+        pthread_cond_destroy(&conn->out_ready);
+        pthread_cond_destroy(&conn->room);
+        free(conn->out);
+        free(conn);
+    }
+}
+
+/* Hand output to the writer; 'jobs' positions are reported by it.
+   Never blocks on the peer. Caller holds conn->lock. */
+static void conn_post_locked(Conn *conn, const char *buf, size_t len, int jobs) {
+    if (!conn->dead && conn->out_len + len > conn->out_cap) {
+        size_t cap = conn->out_cap ? conn->out_cap : 4096;
+        while (cap < conn->out_len + len) cap *= 2;
+        char *out = realloc(conn->out, cap);
+        if (out) {
+            conn->out = out;
+            conn->out_cap = cap;
+        } else {
+            conn->dead = 1;
+        }
+    }
+    if (conn->dead) {
+        conn->inflight -= jobs;
+        pthread_cond_signal(&conn->room);
+        pthread_cond_signal(&conn->out_ready);  /* the writer may be waiting to exit */
+        return;
+    }
+    memcpy(conn->out + conn->out_len, buf, len);
+    conn->out_len += len;
+    conn->out_jobs += jobs;
+    pthread_cond_signal(&conn->out_ready);
+}
+
+/* Post a reply of the reader's own, waiting while too much is unsent */
+static void conn_reply(Conn *conn, const char *buf, size_t len) {
+    pthread_mutex_lock(&conn->lock);
+    while (conn->out_len >= OUT_LIMIT && !conn->dead)
+        pthread_cond_wait(&conn->room, &conn->lock);
+    conn_post_locked(conn, buf, len, 0);
+    pthread_mutex_unlock(&conn->lock);
+}
+
+/* Write the whole buffer. Returns 0 if the peer has gone away. */
+static int send_all(int sock, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(sock, buf, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return 0;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/* Send posted output until the reader is done and nothing is in flight.
+   The buffers are swapped so workers keep posting while this one sends. */
+static void *writer_thread(void *arg) {
+    Conn *conn = arg;
+    char *buf = NULL;
+    size_t cap = 0;
+    pthread_mutex_lock(&conn->lock);
+    while (1) {
+        while (conn->out_len == 0 && (conn->reading || conn->inflight > 0))
+            pthread_cond_wait(&conn->out_ready, &conn->lock);
+        if (conn->out_len == 0) break;
+        char *full = conn->out;
+        size_t len = conn->out_len, full_cap = conn->out_cap;
+        int jobs = conn->out_jobs, dead = conn->dead;
+        conn->out = buf;
+        conn->out_cap = cap;
+        conn->out_len = 0;
+        conn->out_jobs = 0;
+        buf = full;
+        cap = full_cap;
+        pthread_mutex_unlock(&conn->lock);
+
+        int ok = !dead && send_all(conn->sock, buf, len);
+
+        pthread_mutex_lock(&conn->lock);
+        if (!ok) conn->dead = 1;
+        conn->inflight -= jobs;
+        pthread_cond_signal(&conn->room);
+    }
+    pthread_mutex_unlock(&conn->lock);
+    free(buf);
+    conn_release(conn);
+    return NULL;
+}
+
+static void queue_push(const Job *job) {
+    pthread_mutex_lock(&q_mutex);
+    while (q_count == QUEUE_SIZE)
+        pthread_cond_wait(&q_not_full, &q_mutex);
+    queue[(q_head + q_count) % QUEUE_SIZE] = *job;
+    q_count++;
+    pthread_cond_signal(&q_not_empty);
+    pthread_mutex_unlock(&q_mutex);
+}
+
+static void queue_pop(Job *job) {
+    pthread_mutex_lock(&q_mutex);
+    while (q_count == 0)
+        pthread_cond_wait(&q_not_empty, &q_mutex);
+    *job = queue[q_head];
+    q_head = (q_head + 1) % QUEUE_SIZE;
+    q_count--;
+    pthread_cond_signal(&q_not_full);
+    pthread_mutex_unlock(&q_mutex);
+}
+
+/* Report one position and, if it was the last, the end of its batch */
+static void finish_job(Job *job, const char *line) {
+    Batch *batch = job->batch;
+    Conn *conn = batch->conn;
+    char out[2 * LINE_SIZE];
+    int len = snprintf(out, sizeof(out), "%s", line);
+
+    pthread_mutex_lock(&conn->lock);
+    int last = (--batch->remaining == 0);
+    if (last)
+        len += snprintf(out + len, sizeof(out) - len, "%s done %d\n", batch->id, batch->count);
+    conn_post_locked(conn, out, len, 1);
+    pthread_mutex_unlock(&conn->lock);
+    if (last) free(batch);
+    conn_release(conn);
+}
+
+static int conn_dead(Conn *conn) {
+    pthread_mutex_lock(&conn->lock);
+    int dead = conn->dead;
+    pthread_mutex_unlock(&conn->lock);
+    return dead;
+}
+
+static void *worker_thread(void *arg) {
+    (void)arg;
+    Job job;
+    char line[LINE_SIZE];
+    while (1) {
+        queue_pop(&job);
+        Batch *batch = job.batch;
+        if (!job.valid) {
+            snprintf(line, sizeof(line), "%s %d error bad-fen\n", batch->id, job.index);
+        } else if (conn_dead(batch->conn)) {
+            line[0] = '\0';    /* nobody will read the result; don't search */
+        } else {
+            SearchResult res;
+            char mv[5] = "none";
+            search_position(&job.game, &batch->limits, &tt, &res);
+            if (res.has_move) format_move(res.best, mv);
+            snprintf(line, sizeof(line), "%s %d %d %s %d %lld\n",
+                     batch->id, job.index, res.score, mv, res.depth, res.nodes);
+        }
+        finish_job(&job, line);
+    }
+    return NULL;
+}
+
+/* Buffered line reader over a socket */
+typedef struct {
+    int sock;
+    char buf[8192];
+    size_t start, end;
+} LineReader;
+
+/* Returns 1 with a NUL-terminated line (newline stripped), 0 on EOF/error */
+static int read_line(LineReader *lr, char *line, size_t size) {
+    while (1) {
+        char *nl = memchr(lr->buf + lr->start, '\n', lr->end - lr->start);
+        if (nl) {
+            size_t len = nl - (lr->buf + lr->start);
+            if (len >= size) len = size - 1;
+            memcpy(line, lr->buf + lr->start, len);
+            line[len] = '\0';
+            line[strcspn(line, "\r")] = '\0';
+            lr->start = nl - lr->buf + 1;
+            return 1;
+        }
+        if (lr->start > 0) {
+            memmove(lr->buf, lr->buf + lr->start, lr->end - lr->start);
+            lr->end -= lr->start;
+            lr->start = 0;
+        }
+        if (lr->end == sizeof(lr->buf)) lr->end = 0;  /* overlong line: drop it */
+        ssize_t n = recv(lr->sock, lr->buf + lr->end, sizeof(lr->buf) - lr->end, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        lr->end += n;
+    }
+}
+
+/* Parse requests from one connection and feed their positions to the pool */
+static void *reader_thread(void *arg) {
+    Conn *conn = arg;
+    LineReader *lr = malloc(sizeof(LineReader));
+    char line[LINE_SIZE];
+    if (!lr) {
+        conn_release(conn);
+        return NULL;
+    }
+    lr->sock = conn->sock;
+    lr->start = lr->end = 0;
+
+    while (read_line(lr, line, sizeof(line))) {
+        char id[64], reply[LINE_SIZE];
+        int depth, count;
+        long long nodes;
+        if (line[0] == '\0') continue;
+        if (sscanf(line, "BATCH %63s %d %lld %d", id, &depth, &nodes, &count) != 4 || count < 0) {
+            int len = snprintf(reply, sizeof(reply), "error bad-request\n");
+            conn_reply(conn, reply, len);
+            continue;
+        }
+        if (count > MAX_BATCH) {
+            int len = snprintf(reply, sizeof(reply), "%s error bad-request\n", id);
+            conn_reply(conn, reply, len);
+            break;
+        }
+        if (depth <= 0 && nodes <= 0) {
+            /* A search with no limit would pin a worker for good */
+            int i = 0;
+            while (i < count && read_line(lr, line, sizeof(line))) i++;
+            if (i < count) break;
+            int len = snprintf(reply, sizeof(reply), "%s error unbounded\n", id);
+            conn_reply(conn, reply, len);
+            continue;
+        }
+        if (count == 0) {
+            int len = snprintf(reply, sizeof(reply), "%s done 0\n", id);
+            conn_reply(conn, reply, len);
+            continue;
+        }
+
+        Batch *batch = malloc(sizeof(Batch));
+        if (!batch) break;
+        batch->conn = conn;
+        snprintf(batch->id, sizeof(batch->id), "%s", id);
+        batch->limits.depth = depth;
+        batch->limits.nodes = nodes;
+        batch->limits.stop = NULL;
+        batch->count = batch->remaining = count;
+
+        /* Take all job references up front so the batch cannot finish early */
+        pthread_mutex_lock(&conn->lock);
+        conn->refs += count;
+        pthread_mutex_unlock(&conn->lock);
+
+        int i;
+        for (i = 0; i < count; i++) {
+            Job job;
+            job.batch = batch;
+            job.index = i;
+            if (!read_line(lr, line, sizeof(line))) break;
+            job.valid = load_fen(&job.game, line);
+            /* Wait for a slot of our own before taking one in the shared queue */
+            pthread_mutex_lock(&conn->lock);
+            while (conn->inflight >= MAX_INFLIGHT)
+                pthread_cond_wait(&conn->room, &conn->lock);
+            conn->inflight++;
+            pthread_mutex_unlock(&conn->lock);
+            queue_push(&job);
+        }
+        if (i < count) {
+            /* Peer stopped sending mid-batch: settle the positions never
+               queued, so "done" reports only those that were */
+            pthread_mutex_lock(&conn->lock);
+            conn->refs -= count - i;
+            batch->remaining -= count - i;
+            batch->count = i;
+            int last = (batch->remaining == 0);
+            if (last) {
+                int len = snprintf(reply, sizeof(reply), "%s done %d\n", id, i);
+                conn_post_locked(conn, reply, len, 0);
+            }
+            pthread_mutex_unlock(&conn->lock);
+            if (last) free(batch);
+            break;
+        }
+    }
+    free(lr);
+    pthread_mutex_lock(&conn->lock);
+    conn->reading = 0;
+    pthread_cond_signal(&conn->out_ready);
+    pthread_mutex_unlock(&conn->lock);
+    conn_release(conn);
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s socket_path] [-w workers] [-H hash_mb] [-n network]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = DEFAULT_SOCK_PATH;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    long hash_mb = DEFAULT_HASH_MB;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:w:H:n:")) != -1) {
+        switch (opt) {
+            case 's': path = optarg; break;
+            case 'w': workers = atol(optarg); break;
+            case 'H': hash_mb = atol(optarg); break;
+            case 'n':
+                if (!nnue_load(optarg)) exit(1);
+                printf("Loaded network %s (%s kernels).\n", optarg, nnue_kernel_name());
+                break;
+            default: usage(argv[0]);
+        }
+    }
+    if (workers < 1) workers = 1;
+    if (hash_mb < 1) hash_mb = 1;
+
+    signal(SIGPIPE, SIG_IGN);
+    if (!tt_init(&tt, hash_mb)) {
+        fprintf(stderr, "Cannot allocate %ld MB hash table.\n", hash_mb);
+        exit(1);
+    }
+
+    int server_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server_sock < 0) {
+        perror("socket");
+        exit(1);
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        exit(1);
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(server_sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        exit(1);
+    }
+    if (listen(server_sock, SOMAXCONN) < 0) {
+        perror("listen");
+        exit(1);
+    }
+
+    for (long i = 0; i < workers; i++) {
+        pthread_t th;
+        if (pthread_create(&th, NULL, worker_thread, NULL) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+        pthread_detach(th);
+    }
+    printf("Evaluation server on %s with %ld workers.\n", path, workers);
+
+    while (1) {
+        int sock = accept(server_sock, NULL, NULL);
+        if (sock < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        Conn *conn = calloc(1, sizeof(Conn));
+        if (!conn) {
+            close(sock);
+            continue;
+        }
+        conn->sock = sock;
+        conn->refs = 2;
+        conn->reading = 1;
+        pthread_mutex_init(&conn->lock, NULL);
+        pthread_cond_init(&conn->out_ready, NULL);
+        pthread_cond_init(&conn->room, NULL);
+        pthread_t th;
+        if (pthread_create(&th, NULL, writer_thread, conn) != 0) {
+            perror("pthread_create");
+            close(sock);
+            pthread_mutex_destroy(&conn->lock);
+            pthread_cond_destroy(&conn->out_ready);
+            pthread_cond_destroy(&conn->room);
+            free(conn);
+            continue;
+        }
+        pthread_detach(th);
+        if (pthread_create(&th, NULL, reader_thread, conn) != 0) {
+            /* The writer sees the reader finished with nothing in flight */
+            perror("pthread_create");
+            pthread_mutex_lock(&conn->lock);
+            conn->reading = 0;
+            pthread_cond_signal(&conn->out_ready);
+            pthread_mutex_unlock(&conn->lock);
+            conn_release(conn);
+            continue;
+        }
+        pthread_detach(th);
+    }
+    close(server_sock);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,695 @@
+/* gamedb.c: Position-indexed store of finished games */
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gamedb.h"
+
+#define RUN_MAGIC "CHGIDX1"
+#define RUN_HEADER 16           /* magic[8] + uint64 count */
+#define MAX_RUNS 64
+#define BATCH_GAMES 65536       /* games per appended run; bounds memory */
+#define MAX_GAME_PLY 1024
+#define MAX_THREADS 64
+#define LINE_SIZE (MAX_GAME_PLY * 6 + 64)
+
+typedef struct {
+    char name[32];
+    uint64_t count;
+    void *map;
+    size_t map_len;
+    const GameIndexEntry *entries;
+} Run;
+
+struct GameDB {
+    char dir[PATH_MAX - 64];    /* leaves room for file names */
+    uint64_t games;         /* committed games */
+    uint64_t data_size;     /* committed bytes of games.dat */
+    uint64_t next_run;
+    Run runs[MAX_RUNS];     /* oldest (largest) first */
+    int nruns;
+    void *off_map, *data_map;
+    size_t off_len, data_len;
+};
+
+/* A game parsed from text, before replay */
+typedef struct {
+    int8_t result;
+    int valid;
+    uint16_t nmoves;
+    uint16_t *moves;
+} ParsedGame;
+
+/* Per-thread slice of a batch */
+typedef struct {
+    ParsedGame *games;
+    const uint32_t *ids;    /* batch index -> game id, for the second phase */
+    size_t begin, end;
+    GameIndexEntry *entries;
+    size_t count;
+} Slice;
+
+static void path_of(const GameDB *db, const char *name, char *out) {
+    /* 'dir' leaves room for every name we use; never act on a cut-off path */
+    if (snprintf(out, PATH_MAX, "%s/%s", db->dir, name) >= PATH_MAX) out[0] = '\0';
+}
+
+/* Map a whole file read-only; an empty or missing file maps to NULL */
+static void *map_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    *len = 0;
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    *len = st.st_size;
+    return map;
+}
+
+static void unmap_games(GameDB *db) {
+    if (db->off_map) munmap(db->off_map, db->off_len);
+    if (db->data_map) munmap(db->data_map, db->data_len);
+    db->off_map = db->data_map = NULL;
+}
+
+static void map_games(GameDB *db) {
+    char path[PATH_MAX];
+    unmap_games(db);
+    path_of(db, "games.off", path);
+    db->off_map = map_file(path, &db->off_len);
+    path_of(db, "games.dat", path);
+    db->data_map = map_file(path, &db->data_len);
+}
+
+static int open_run(GameDB *db, Run *run) {
+    char path[PATH_MAX];
+    path_of(db, run->name, path);
+    run->map = map_file(path, &run->map_len);
+    if (!run->map || run->map_len != RUN_HEADER + run->count * sizeof(GameIndexEntry) ||
+        memcmp(run->map, RUN_MAGIC, sizeof(RUN_MAGIC)) != 0) {
+        fprintf(stderr, "gamedb: run %s is missing or damaged\n", path);
+        if (run->map) munmap(run->map, run->map_len);
+        run->map = NULL;
+        return 0;
+    }
+    madvise(run->map, run->map_len, MADV_RANDOM);
+    run->entries = (const GameIndexEntry *)((const char *)run->map + RUN_HEADER);
+    return 1;
+}
+
+static void close_run(Run *run) {
+    if (run->map) munmap(run->map, run->map_len);
+    run->map = NULL;
+}
+
+/* Replace MANIFEST atomically */
+static int write_manifest(GameDB *db) {
+    char path[PATH_MAX], tmp[PATH_MAX];
+    path_of(db, "MANIFEST", path);
+    path_of(db, "MANIFEST.tmp", tmp);
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        return 0;
+    }
+    fprintf(f, "games %llu\ndata %llu\nnext %llu\n", (unsigned long long)db->games,
+            (unsigned long long)db->data_size, (unsigned long long)db->next_run);
+    for (int i = 0; i < db->nruns; i++)
+        fprintf(f, "run %s %llu\n", db->runs[i].name, (unsigned long long)db->runs[i].count);
+    int ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+    if (fclose(f) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) {
+        perror(path);
+        return 0;
+    }
+    return 1;
+}
+
+static int read_manifest(GameDB *db) {
+    char path[PATH_MAX], line[256];
+    path_of(db, "MANIFEST", path);
+    FILE *f = fopen(path, "r");
+    if (!f) return errno == ENOENT ? 0 : -1;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long v;
+        char name[32];
+        if (sscanf(line, "games %llu", &v) == 1) db->games = v;
+        else if (sscanf(line, "data %llu", &v) == 1) db->data_size = v;
+        else if (sscanf(line, "next %llu", &v) == 1) db->next_run = v;
+        else if (sscanf(line, "run %31s %llu", name, &v) == 2 && db->nruns < MAX_RUNS) {
+            Run *run = &db->runs[db->nruns];
+            memset(run, 0, sizeof(*run));
+            snprintf(run->name, sizeof(run->name), "%s", name);
+            run->count = v;
+            if (!open_run(db, run)) {
+                fclose(f);
+                return -1;
+            }
+            db->nruns++;
+        }
+    }
+    fclose(f);
+    return 1;
+}
+
+GameDB *gamedb_open(const char *dir, int create) {
+    GameDB *db = calloc(1, sizeof(GameDB));
+    if (!db) return NULL;
+    if (strlen(dir) >= sizeof(db->dir)) {
+        fprintf(stderr, "gamedb: path too long: %s\n", dir);
+        free(db);
+        return NULL;
+    }
+    strcpy(db->dir, dir);
+    if (create && mkdir(dir, 0755) < 0 && errno != EEXIST) {
+        perror(dir);
+        free(db);
+        return NULL;
+    }
+    int rc = read_manifest(db);
+    if (rc < 0 || (rc == 0 && !create)) {
+        if (rc == 0) fprintf(stderr, "gamedb: %s is not a game store\n", dir);
+        gamedb_close(db);
+        return NULL;
+    }
+    map_games(db);
+    return db;
+}
+
+void gamedb_close(GameDB *db) {
+    if (!db) return;
+    for (int i = 0; i < db->nruns; i++) close_run(&db->runs[i]);
+    unmap_games(db);
+    free(db);
+}
+
+size_t gamedb_game_count(const GameDB *db) {
+    return db->games;
+}
+
+int gamedb_run_count(const GameDB *db) {
+    return db->nruns;
+}
+
+static int entry_cmp(const void *pa, const void *pb) {
+    const GameIndexEntry *a = pa, *b = pb;
+    if (a->hash != b->hash) return a->hash < b->hash ? -1 : 1;
+    if (a->game != b->game) return a->game < b->game ? -1 : 1;
+    return (int)a->ply - (int)b->ply;
+}
+
+/* Streams sorted entries into a new run file */
+typedef struct {
+    FILE *f;
+    uint64_t count;
+    char tmp[PATH_MAX];
+} RunWriter;
+
+static int run_begin(GameDB *db, RunWriter *w, Run *run) {
+    snprintf(run->name, sizeof(run->name), "run-%llu.idx", (unsigned long long)db->next_run++);
+    path_of(db, run->name, w->tmp);
+    strcat(w->tmp, ".tmp");
+    w->f = fopen(w->tmp, "wb");
+    w->count = 0;
+    if (!w->f) {
+        perror(w->tmp);
+        return 0;
+    }
+    setvbuf(w->f, NULL, _IOFBF, 1 << 20);
+    char header[RUN_HEADER] = {0};
+    fwrite(header, 1, RUN_HEADER, w->f);   /* filled in by run_end */
+    return 1;
+}
+
+static void run_put(RunWriter *w, const GameIndexEntry *e) {
+    fwrite(e, sizeof(*e), 1, w->f);
+    w->count++;
+}
+
+static int run_end(GameDB *db, RunWriter *w, Run *run) {
+    char header[RUN_HEADER] = {0}, path[PATH_MAX];
+    memcpy(header, RUN_MAGIC, sizeof(RUN_MAGIC));
+    memcpy(header + 8, &w->count, sizeof(w->count));
+    int ok = fseek(w->f, 0, SEEK_SET) == 0 && fwrite(header, 1, RUN_HEADER, w->f) == RUN_HEADER &&
+             fflush(w->f) == 0 && fsync(fileno(w->f)) == 0;
+    if (fclose(w->f) != 0) ok = 0;
+    path_of(db, run->name, path);
+    if (!ok || rename(w->tmp, path) != 0) {
+        perror(path);
+        unlink(w->tmp);
+        return 0;
+    }
+    run->count = w->count;
+    return open_run(db, run);
+}
+
+/* Unmap a run no longer listed in MANIFEST and delete its file */
+static void remove_run(GameDB *db, Run *run) {
+    char path[PATH_MAX];
+    close_run(run);
+    path_of(db, run->name, path);
+    unlink(path);
+}
+
+/* Write the merge of runs 'a' and 'b' as a new run, not yet in MANIFEST */
+static int merge_runs(GameDB *db, const Run *a, const Run *b, Run *merged) {
+    RunWriter w;
+    memset(merged, 0, sizeof(*merged));
+    if (!run_begin(db, &w, merged)) return 0;
+    madvise(a->map, a->map_len, MADV_SEQUENTIAL);
+    madvise(b->map, b->map_len, MADV_SEQUENTIAL);
+    uint64_t x = 0, y = 0;
+    while (x < a->count || y < b->count) {
+        if (y == b->count || (x < a->count && entry_cmp(&a->entries[x], &b->entries[y]) <= 0))
+            run_put(&w, &a->entries[x++]);
+        else
+            run_put(&w, &b->entries[y++]);
+    }
+    return run_end(db, &w, merged);
+}
+
+/* Merge runs i and i+1 (adjacent in age) into one */
+static int merge_pair(GameDB *db, int i) {
+    Run merged;
+    if (!merge_runs(db, &db->runs[i], &db->runs[i + 1], &merged)) return 0;
+
+    Run old_a = db->runs[i], old_b = db->runs[i + 1];
+    db->runs[i] = merged;
+    memmove(&db->runs[i + 1], &db->runs[i + 2], (db->nruns - i - 2) * sizeof(Run));
+    db->nruns--;
+    if (!write_manifest(db)) return 0;
+
+    /* Only now are the inputs unreferenced */
+    remove_run(db, &old_a);
+    remove_run(db, &old_b);
+    return 1;
+}
+
+/* Merge the newest run into its elder while they are of similar size */
+static int merge_tail(GameDB *db) {
+    while (db->nruns >= 2 &&
+           (db->runs[db->nruns - 2].count <= 2 * db->runs[db->nruns - 1].count ||
+            db->nruns == MAX_RUNS)) {
+        if (!merge_pair(db, db->nruns - 2)) return 0;
+    }
+    return 1;
+}
+
+int gamedb_compact(GameDB *db) {
+    while (db->nruns >= 2) {
+        if (!merge_pair(db, db->nruns - 2)) return 0;
+    }
+    return 1;
+}
+
+/* Parse "<result> e2e4 e7e5 ..." without checking legality */
+static int parse_game(char *line, ParsedGame *g) {
+    char *save, *tok = strtok_r(line, " \t\r\n", &save);
+    if (!tok) return 0;
+    if (strcmp(tok, "1-0") == 0) g->result = GAMEDB_WHITE_WINS;
+    else if (strcmp(tok, "0-1") == 0) g->result = GAMEDB_BLACK_WINS;
+    else if (strcmp(tok, "1/2-1/2") == 0) g->result = GAMEDB_DRAW;
+    else if (strcmp(tok, "*") == 0) g->result = GAMEDB_UNKNOWN;
+    else return 0;
+    uint16_t moves[MAX_GAME_PLY];
+    g->nmoves = 0;
+    g->valid = 1;
+    while ((tok = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        Move m;
+        int sr, sc, dr, dc;
+        if (g->nmoves == MAX_GAME_PLY || !parse_move(tok, &sr, &sc, &dr, &dc)) {
+            g->valid = 0;
+            break;
+        }
+        m.src_row = sr; m.src_col = sc; m.dst_row = dr; m.dst_col = dc;
+        moves[g->nmoves++] = move_pack(m);
+    }
+    g->moves = malloc(g->nmoves * sizeof(uint16_t) + 1);
+    if (!g->moves) return 0;
+    memcpy(g->moves, moves, g->nmoves * sizeof(uint16_t));
+    return 1;
+}
+
+/* Phase one: replay each game, recording the position before every ply
+   and the final one. Entries carry the batch index until ids are known. */
+static void *replay_thread(void *arg) {
+    Slice *sl = arg;
+    size_t cap = 0;
+    sl->count = 0;
+    for (size_t i = sl->begin; i < sl->end; i++) cap += sl->games[i].nmoves + 1;
+    sl->entries = malloc((cap ? cap : 1) * sizeof(GameIndexEntry));
+    if (!sl->entries) return NULL;
+
+    for (size_t i = sl->begin; i < sl->end; i++) {
+        ParsedGame *g = &sl->games[i];
+        GameState game;
+        size_t start = sl->count;
+        if (!g->valid) continue;
+        init_board(&game);
+        for (int ply = 0; ply <= g->nmoves; ply++) {
+            GameIndexEntry *e = &sl->entries[sl->count++];
+            e->hash = position_hash(&game);
+            e->game = (uint32_t)i;
+            e->ply = (uint16_t)ply;
+            e->result = g->result;
+            e->reserved = 0;
+            if (ply == g->nmoves) break;
+            Move m = move_unpack(g->moves[ply]);
+            if (!make_move(&game, m.src_row, m.src_col, m.dst_row, m.dst_col)) {
+                g->valid = 0;
+                sl->count = start;
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Phase two: assign real ids, drop invalid games, sort the slice */
+static void *sort_thread(void *arg) {
+    Slice *sl = arg;
+    size_t out = 0;
+    if (!sl->entries) return NULL;
+    for (size_t k = 0; k < sl->count; k++) {
+        GameIndexEntry e = sl->entries[k];
+        if (!sl->games[e.game].valid) continue;
+        e.game = sl->ids[e.game];
+        sl->entries[out++] = e;
+    }
+    sl->count = out;
+    qsort(sl->entries, sl->count, sizeof(GameIndexEntry), entry_cmp);
+    return NULL;
+}
+
+static void init_slices(Slice *slices, int threads, ParsedGame *games,
+                        const uint32_t *ids, size_t n) {
+    for (int t = 0; t < threads; t++) {
+        slices[t].games = games;
+        slices[t].ids = ids;
+        slices[t].begin = n * t / threads;
+        slices[t].end = n * (t + 1) / threads;
+        slices[t].entries = NULL;
+    }
+}
+
+static void run_threads(void *(*fn)(void *), Slice *slices, int threads) {
+    pthread_t th[threads];
+    int started[threads];
+    for (int t = 0; t < threads; t++)
+        started[t] = pthread_create(&th[t], NULL, fn, &slices[t]) == 0;
+    for (int t = 0; t < threads; t++) {
+        if (started[t]) pthread_join(th[t], NULL);
+        else fn(&slices[t]);
+    }
+}
+
+/* Append valid games of a batch to games.dat/games.off */
+static int store_games(GameDB *db, ParsedGame *games, size_t n) {
+    char path[PATH_MAX];
+    path_of(db, "games.dat", path);
+    FILE *data = fopen(path, "r+b");
+    if (!data) data = fopen(path, "w+b");
+    path_of(db, "games.off", path);
+    FILE *off = fopen(path, "r+b");
+    if (!off) off = fopen(path, "w+b");
+    if (!data || !off) {
+        perror(path);
+        if (data) fclose(data);
+        if (off) fclose(off);
+        return 0;
+    }
+    /* Drop anything a failed append left past the committed end */
+    int ok = ftruncate(fileno(data), db->data_size) == 0 &&
+             ftruncate(fileno(off), db->games * sizeof(uint64_t)) == 0 &&
+             fseek(data, db->data_size, SEEK_SET) == 0 &&
+             fseek(off, db->games * sizeof(uint64_t), SEEK_SET) == 0;
+    uint64_t pos = db->data_size;
+    for (size_t i = 0; ok && i < n; i++) {
+        if (!games[i].valid) continue;
+        unsigned char head[4];
+        head[0] = games[i].nmoves & 0xFF;
+        head[1] = games[i].nmoves >> 8;
+        head[2] = (unsigned char)games[i].result;
+        head[3] = 0;
+        ok = fwrite(&pos, sizeof(pos), 1, off) == 1 && fwrite(head, 1, 4, data) == 4 &&
+             fwrite(games[i].moves, 2, games[i].nmoves, data) == games[i].nmoves;
+        pos += 4 + 2 * games[i].nmoves;
+    }
+    if (ok) ok = fflush(data) == 0 && fsync(fileno(data)) == 0 &&
+                 fflush(off) == 0 && fsync(fileno(off)) == 0;
+    if (fclose(data) != 0) ok = 0;
+    if (fclose(off) != 0) ok = 0;
+    if (ok) db->data_size = pos;
+    return ok;
+}
+
+/* k-way merge of a batch's sorted slices into a new run, not yet in MANIFEST */
+static int write_slices(GameDB *db, Slice *slices, int threads, Run *run) {
+    size_t pos[threads];
+    RunWriter w;
+    memset(run, 0, sizeof(*run));
+    memset(pos, 0, sizeof(pos));
+    if (!run_begin(db, &w, run)) return 0;
+    while (1) {
+        int best = -1;
+        for (int t = 0; t < threads; t++) {
+            if (pos[t] < slices[t].count &&
+                (best < 0 || entry_cmp(&slices[t].entries[pos[t]],
+                                       &slices[best].entries[pos[best]]) < 0))
+                best = t;
+        }
+        if (best < 0) break;
+        run_put(&w, &slices[best].entries[pos[best]++]);
+    }
+    return run_end(db, &w, run);
+}
+
+/* Index one batch: replay in parallel, write a run, commit, merge */
+static long append_batch(GameDB *db, ParsedGame *games, size_t n, int threads) {
+    Slice slices[threads];
+    uint32_t *ids = malloc((n ? n : 1) * sizeof(uint32_t));
+    long added = -1;
+    if (!ids) return -1;
+    init_slices(slices, threads, games, ids, n);
+    run_threads(replay_thread, slices, threads);
+
+    uint32_t next = (uint32_t)db->games;
+    for (size_t i = 0; i < n; i++) {
+        if (games[i].valid) ids[i] = next++;
+    }
+    run_threads(sort_thread, slices, threads);
+    for (int t = 0; t < threads; t++) {
+        if (!slices[t].entries) goto done;
+    }
+    if (db->nruns == MAX_RUNS && !gamedb_compact(db)) goto done;
+    if (!store_games(db, games, n)) goto done;
+
+    if (!write_slices(db, slices, threads, &db->runs[db->nruns])) goto done;
+    db->nruns++;
+    added = next - db->games;
+    db->games = next;
+    if (!write_manifest(db) || !merge_tail(db)) added = -1;
+done:
+    for (int t = 0; t < threads; t++) free(slices[t].entries);
+    free(ids);
+    return added;
+}
+
+long gamedb_append(GameDB *db, FILE *in, int threads) {
+    ParsedGame *games = malloc(BATCH_GAMES * sizeof(ParsedGame));
+    char *line = malloc(LINE_SIZE);
+    long total = 0;
+    size_t n = 0;
+    int eof = 0;
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (!games || !line) {
+        free(games);
+        free(line);
+        return -1;
+    }
+    while (!eof) {
+        if (fgets(line, LINE_SIZE, in)) {
+            if (parse_game(line, &games[n])) n++;
+        } else {
+            eof = 1;
+        }
+        if (n == BATCH_GAMES || (eof && n > 0)) {
+            long added = append_batch(db, games, n, threads);
+            for (size_t i = 0; i < n; i++) free(games[i].moves);
+            n = 0;
+            if (added < 0) {
+                total = -1;
+                break;
+            }
+            total += added;
+        }
+    }
+    free(games);
+    free(line);
+    map_games(db);
+    return total;
+}
+
+/* Load stored game 'id' for replay. Returns 0 if the data is damaged. */
+static int load_game(const GameDB *db, uint32_t id, ParsedGame *g) {
+    Move moves[MAX_GAME_PLY];
+    int result;
+    int n = gamedb_read_game(db, id, moves, MAX_GAME_PLY, &result);
+    if (n < 0 || n > MAX_GAME_PLY) return 0;
+    g->result = (int8_t)result;
+    g->valid = 1;
+    g->nmoves = (uint16_t)n;
+    g->moves = malloc(n * sizeof(uint16_t) + 1);
+    if (!g->moves) return 0;
+    for (int i = 0; i < n; i++) g->moves[i] = move_pack(moves[i]);
+    return 1;
+}
+
+long gamedb_reindex(GameDB *db, int threads) {
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    ParsedGame *games = calloc(BATCH_GAMES, sizeof(ParsedGame));
+    uint32_t *ids = malloc(BATCH_GAMES * sizeof(uint32_t));
+    Run fresh[MAX_RUNS];    /* the new index; MANIFEST keeps the old one until done */
+    int nfresh = 0, ok = games && ids;
+
+    for (uint64_t first = 0; ok && first < db->games; first += BATCH_GAMES) {
+        size_t n = db->games - first < BATCH_GAMES ? db->games - first : BATCH_GAMES;
+        Slice slices[threads];
+        for (size_t i = 0; ok && i < n; i++) {
+            ids[i] = (uint32_t)(first + i);
+            if (!load_game(db, ids[i], &games[i])) {
+                fprintf(stderr, "gamedb: game %u is damaged\n", ids[i]);
+                ok = 0;
+            }
+        }
+        if (ok) {
+            init_slices(slices, threads, games, ids, n);
+            run_threads(replay_thread, slices, threads);
+            run_threads(sort_thread, slices, threads);
+            for (int t = 0; t < threads; t++) {
+                if (!slices[t].entries) ok = 0;
+            }
+            for (size_t i = 0; ok && i < n; i++) {
+                if (!games[i].valid) {
+                    fprintf(stderr, "gamedb: game %u no longer replays\n", ids[i]);
+                    ok = 0;
+                }
+            }
+            if (ok && !write_slices(db, slices, threads, &fresh[nfresh])) ok = 0;
+            if (ok) nfresh++;
+            for (int t = 0; t < threads; t++) free(slices[t].entries);
+        }
+        for (size_t i = 0; i < n; i++) {
+            free(games[i].moves);
+            games[i].moves = NULL;
+        }
+        /* Same shape as appends produce: merge while sizes are similar */
+        while (ok && nfresh >= 2 &&
+               (fresh[nfresh - 2].count <= 2 * fresh[nfresh - 1].count || nfresh == MAX_RUNS)) {
+            Run merged;
+            if (!merge_runs(db, &fresh[nfresh - 2], &fresh[nfresh - 1], &merged)) {
+                ok = 0;
+                break;
+            }
+            remove_run(db, &fresh[nfresh - 2]);
+            remove_run(db, &fresh[nfresh - 1]);
+            fresh[nfresh - 2] = merged;
+            nfresh--;
+        }
+    }
+
+    /* Switch MANIFEST to the new runs, then drop the old ones */
+    Run old[MAX_RUNS];
+    int nold = db->nruns;
+    memcpy(old, db->runs, nold * sizeof(Run));
+    if (ok) {
+        memcpy(db->runs, fresh, nfresh * sizeof(Run));
+        db->nruns = nfresh;
+        ok = write_manifest(db);
+        if (!ok) {
+            memcpy(db->runs, old, nold * sizeof(Run));
+            db->nruns = nold;
+        }
+    }
+    if (ok) {
+        for (int i = 0; i < nold; i++) remove_run(db, &old[i]);
+    } else {
+        for (int i = 0; i < nfresh; i++) remove_run(db, &fresh[i]);
+    }
+    long done = ok ? (long)db->games : -1;
+    free(games);
+    free(ids);
+    return done;
+}
+
+/* First entry with hash >= key */
+static uint64_t lower_bound(const Run *run, uint64_t key) {
+    uint64_t lo = 0, hi = run->count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (run->entries[mid].hash < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+size_t gamedb_query(const GameDB *db, const GameState *game,
+                    GameHit *hits, size_t max, GameSummary *summary) {
+    uint64_t key = position_hash(game);
+    size_t found = 0;
+    if (summary) memset(summary, 0, sizeof(*summary));
+    /* Runs hold disjoint games, and entries of a game are adjacent and
+       in ply order, so the first entry per game id is its earliest ply */
+    for (int r = 0; r < db->nruns; r++) {
+        const Run *run = &db->runs[r];
+        int64_t last = -1;
+        for (uint64_t i = lower_bound(run, key); i < run->count && run->entries[i].hash == key; i++) {
+            const GameIndexEntry *e = &run->entries[i];
+            if ((int64_t)e->game == last) continue;
+            last = e->game;
+            if (found < max) {
+                hits[found].game = e->game;
+                hits[found].ply = e->ply;
+                hits[found].result = e->result;
+            }
+            found++;
+            if (summary) {
+                summary->games++;
+                switch (e->result) {
+                    case GAMEDB_WHITE_WINS: summary->white_wins++; break;
+                    case GAMEDB_BLACK_WINS: summary->black_wins++; break;
+                    case GAMEDB_DRAW: summary->draws++; break;
+                    default: summary->unknown++; break;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+int gamedb_read_game(const GameDB *db, uint32_t id, Move *moves, int max, int *result) {
+    if (id >= db->games || !db->off_map || (id + 1) * sizeof(uint64_t) > db->off_len) return -1;
+    uint64_t pos = ((const uint64_t *)db->off_map)[id];
+    const unsigned char *data = db->data_map;
+    if (!data || pos + 4 > db->data_len) return -1;
+    int nmoves = data[pos] | (data[pos + 1] << 8);
+    if (pos + 4 + 2 * (uint64_t)nmoves > db->data_len) return -1;
+    if (result) *result = (int8_t)data[pos + 2];
+    for (int i = 0; i < nmoves && i < max; i++) {
+        uint16_t v = data[pos + 4 + 2 * i] | (data[pos + 5 + 2 * i] << 8);
+        moves[i] = move_unpack(v);
+    }
+    return nmoves;
+}
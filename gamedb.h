@@ -0,0 +1,79 @@
+/* gamedb.h: Position-indexed store of finished games */
+#ifndef GAMEDB_H
+#define GAMEDB_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "chess.h"
+
+/* A store is a directory holding:
+     games.dat   per game: uint16 ply count, int8 result, uint8 0, then
+                 ply count moves packed by move_pack (2 bytes each)
+     games.off   uint64 offset into games.dat per game id
+     run-N.idx   sorted index runs (header, then GameIndexEntry[count])
+     MANIFEST    game count, data size and the live runs; replaced
+                 atomically, so anything it does not list is ignored
+   Each game is indexed in exactly one run. Appends add a run and then
+   merge neighbouring runs of similar size, keeping the run count
+   logarithmic in the number of games. */
+
+/* Results as stored */
+#define GAMEDB_WHITE_WINS 1
+#define GAMEDB_DRAW 0
+#define GAMEDB_BLACK_WINS (-1)
+#define GAMEDB_UNKNOWN 2
+
+/* One index entry: sorted by hash, then game, then ply */
+typedef struct {
+    uint64_t hash;      /* position_hash() before the move at 'ply' */
+    uint32_t game;
+    uint16_t ply;
+    int8_t result;      /* copied from the game so summaries never touch games.dat */
+    uint8_t reserved;
+} GameIndexEntry;
+
+typedef struct {
+    uint32_t game;
+    uint16_t ply;
+    int8_t result;
+} GameHit;
+
+typedef struct {
+    size_t games;       /* distinct games reaching the position */
+    size_t white_wins, draws, black_wins, unknown;
+} GameSummary;
+
+typedef struct GameDB GameDB;
+
+/* Open a store; with 'create' the directory is created if missing.
+   Returns NULL on error (reported on stderr). */
+GameDB *gamedb_open(const char *dir, int create);
+void gamedb_close(GameDB *db);
+
+size_t gamedb_game_count(const GameDB *db);
+int gamedb_run_count(const GameDB *db);
+
+/* Append games read from text, one per line: a result ("1-0", "0-1",
+   "1/2-1/2" or "*") followed by moves like "e2e4". Games are replayed
+   with make_move on 'threads' threads; a game with an illegal move is
+   skipped. Returns the number of games added, or -1 on error. */
+long gamedb_append(GameDB *db, FILE *in, int threads);
+
+/* Merge all runs into one */
+int gamedb_compact(GameDB *db);
+
+/* Rebuild the index from the stored games on 'threads' threads, e.g. after
+   position_hash() changed. Returns the number of games indexed, or -1 on
+   error (the old index is then kept). */
+long gamedb_reindex(GameDB *db, int threads);
+
+/* Find games that reached 'game'. Fills up to 'max' hits (first ply per
+   game) and 'summary' if non-NULL. Returns the number of distinct games. */
+size_t gamedb_query(const GameDB *db, const GameState *game,
+                    GameHit *hits, size_t max, GameSummary *summary);
+
+/* Read a game's moves. Returns the ply count (at most 'max' moves are
+   written), or -1 if the id is out of range. */
+int gamedb_read_game(const GameDB *db, uint32_t id, Move *moves, int max, int *result);
+
+#endif /* GAMEDB_H */
@@ -0,0 +1,162 @@
+/* gamedbtool.c: Command-line access to a position-indexed game store.
+ *
+ *   gamedb append <dir> [file] [-j threads]   index games (stdin if no file)
+ *   gamedb query <dir> <fen|startpos> [-n max] list games reaching a position
+ *   gamedb show <dir> <game id>                print a game's moves
+ *   gamedb compact <dir>                       merge all index runs into one
+ *   gamedb reindex <dir> [-j threads]          rebuild the index from the games
+ *   gamedb stats <dir>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "chess.h"
+#include "gamedb.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *result_str(int result) {
+    switch (result) {
+        case GAMEDB_WHITE_WINS: return "1-0";
+        case GAMEDB_BLACK_WINS: return "0-1";
+        case GAMEDB_DRAW: return "1/2-1/2";
+        default: return "*";
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s append <dir> [file] [-j threads]\n"
+                    "       %s query <dir> <fen|startpos> [-n max]\n"
+                    "       %s show <dir> <game id>\n"
+                    "       %s compact <dir>\n"
+                    "       %s reindex <dir> [-j threads]\n"
+                    "       %s stats <dir>\n", prog, prog, prog, prog, prog, prog);
+    exit(1);
+}
+
+static int cmd_append(int argc, char *argv[]) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *file = NULL;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else file = argv[i];
+    }
+    FILE *in = file ? fopen(file, "r") : stdin;
+    if (!in) {
+        perror(file);
+        return 1;
+    }
+    GameDB *db = gamedb_open(argv[2], 1);
+    if (!db) return 1;
+    double t0 = now_sec();
+    long added = gamedb_append(db, in, threads);
+    double dt = now_sec() - t0;
+    if (file) fclose(in);
+    if (added < 0) {
+        gamedb_close(db);
+        return 1;
+    }
+    printf("Added %ld games in %.2f s (%.0f games/sec); %zu games in %d runs.\n",
+           added, dt, dt > 0 ? added / dt : 0.0, gamedb_game_count(db), gamedb_run_count(db));
+    gamedb_close(db);
+    return 0;
+}
+
+static int cmd_reindex(int argc, char *argv[]) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else return 2;
+    }
+    GameDB *db = gamedb_open(argv[2], 0);
+    if (!db) return 1;
+    double t0 = now_sec();
+    long games = gamedb_reindex(db, threads);
+    gamedb_close(db);
+    if (games < 0) return 1;
+    printf("Reindexed %ld games in %.2f s.\n", games, now_sec() - t0);
+    return 0;
+}
+
+static int cmd_query(int argc, char *argv[]) {
+    size_t max = 20;
+    GameState game;
+    if (argc < 4) return 2;
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) max = strtoul(argv[++i], NULL, 10);
+    }
+    if (strcmp(argv[3], "startpos") == 0) init_board(&game);
+    else if (!load_fen(&game, argv[3])) {
+        fprintf(stderr, "Invalid FEN: %s\n", argv[3]);
+        return 1;
+    }
+    GameDB *db = gamedb_open(argv[2], 0);
+    if (!db) return 1;
+    GameHit *hits = malloc((max ? max : 1) * sizeof(GameHit));
+    GameSummary sum;
+    if (!hits) {
+        gamedb_close(db);
+        return 1;
+    }
+    double t0 = now_sec();
+    size_t found = gamedb_query(db, &game, hits, max, &sum);
+    double dt = now_sec() - t0;
+    printf("%zu games (%zu 1-0, %zu 1/2-1/2, %zu 0-1, %zu unfinished) in %.3f ms\n",
+           found, sum.white_wins, sum.draws, sum.black_wins, sum.unknown, dt * 1000);
+    for (size_t i = 0; i < found && i < max; i++)
+        printf("game %u ply %u %s\n", hits[i].game, hits[i].ply, result_str(hits[i].result));
+    free(hits);
+    gamedb_close(db);
+    return 0;
+}
+
+static int cmd_show(int argc, char *argv[]) {
+    Move moves[1024];
+    char mv[5];
+    int result;
+    if (argc < 4) return 2;
+    GameDB *db = gamedb_open(argv[2], 0);
+    if (!db) return 1;
+    int n = gamedb_read_game(db, (uint32_t)strtoul(argv[3], NULL, 10), moves, 1024, &result);
+    gamedb_close(db);
+    if (n < 0) {
+        fprintf(stderr, "No game %s.\n", argv[3]);
+        return 1;
+    }
+    printf("%s", result_str(result));
+    for (int i = 0; i < n && i < 1024; i++) {
+        format_move(moves[i], mv);
+        printf(" %s", mv);
+    }
+    printf("\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) usage(argv[0]);
+    int rc = 2;
+    if (strcmp(argv[1], "append") == 0) {
+        rc = cmd_append(argc, argv);
+    } else if (strcmp(argv[1], "query") == 0) {
+        rc = cmd_query(argc, argv);
+    } else if (strcmp(argv[1], "show") == 0) {
+        rc = cmd_show(argc, argv);
+    } else if (strcmp(argv[1], "reindex") == 0) {
+        rc = cmd_reindex(argc, argv);
+    } else if (strcmp(argv[1], "compact") == 0 || strcmp(argv[1], "stats") == 0) {
+        GameDB *db = gamedb_open(argv[2], 0);
+        if (!db) return 1;
+        rc = 0;
+        if (argv[1][0] == 'c' && !gamedb_compact(db)) rc = 1;
+        printf("%zu games in %d runs.\n", gamedb_game_count(db), gamedb_run_count(db));
+        gamedb_close(db);
+    }
+    if (rc == 2) usage(argv[0]);
+    return rc;
+}
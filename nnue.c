@@ -0,0 +1,304 @@
+/* nnue.c: Quantized neural evaluation with AVX2 and scalar kernels */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define NNUE_X86 1              /* AVX2 kernels built, chosen at run time */
+#include <immintrin.h>
+#endif
+#include "nnue.h"
+
+#define HEADER_SIZE 16
+#define B1_OFFSET   HEADER_SIZE
+#define W1_OFFSET   (B1_OFFSET + NNUE_HIDDEN * 2)
+#define W2_OFFSET   (W1_OFFSET + NNUE_INPUTS * NNUE_HIDDEN * 2)
+#define B2_OFFSET   (W2_OFFSET + 2 * NNUE_HIDDEN)
+#define FILE_SIZE   (B2_OFFSET + 4)
+
+/* Weights point into the mapped file (or a buffer parsed from text) */
+static const int16_t *b1, *w1;
+static const int8_t *w2;
+static int32_t b2;
+static const unsigned char *image;
+static int loaded;
+
+/* Kernels, selected at load time */
+static void acc_add_scalar(int16_t *acc, const int16_t *w);
+static void acc_sub_scalar(int16_t *acc, const int16_t *w);
+static int32_t output_scalar(const int16_t *us, const int16_t *them, const int8_t *w);
+static void (*acc_add)(int16_t *, const int16_t *) = acc_add_scalar;
+static void (*acc_sub)(int16_t *, const int16_t *) = acc_sub_scalar;
+static int32_t (*output)(const int16_t *, const int16_t *, const int8_t *) = output_scalar;
+static const char *kernel_name = "scalar";
+
+static void acc_add_scalar(int16_t *acc, const int16_t *w) {
+    for (int i = 0; i < NNUE_HIDDEN; i++) acc[i] += w[i];
+}
+
+static void acc_sub_scalar(int16_t *acc, const int16_t *w) {
+    for (int i = 0; i < NNUE_HIDDEN; i++) acc[i] -= w[i];
+}
+
+static int32_t output_scalar(const int16_t *us, const int16_t *them, const int8_t *w) {
+    int32_t sum = 0;
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int a = us[i] < 0 ? 0 : (us[i] > NNUE_CLIP ? NNUE_CLIP : us[i]);
+        int b = them[i] < 0 ? 0 : (them[i] > NNUE_CLIP ? NNUE_CLIP : them[i]);
+        sum += a * w[i] + b * w[NNUE_HIDDEN + i];
+    }
+    return sum;
+}
+
+#ifdef NNUE_X86
+__attribute__((target("avx2")))
+static void acc_add_avx2(int16_t *acc, const int16_t *w) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i a = _mm256_load_si256((const __m256i *)(acc + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(w + i));
+        _mm256_store_si256((__m256i *)(acc + i), _mm256_add_epi16(a, b));
+    }
+}
+
+__attribute__((target("avx2")))
+static void acc_sub_avx2(int16_t *acc, const int16_t *w) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i a = _mm256_load_si256((const __m256i *)(acc + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(w + i));
+        _mm256_store_si256((__m256i *)(acc + i), _mm256_sub_epi16(a, b));
+    }
+}
+
+/* Clip 32 accumulator values to [0, NNUE_CLIP] and pack them to bytes in order */
+__attribute__((target("avx2")))
+static __m256i clip_pack(const int16_t *acc) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i clip = _mm256_set1_epi16(NNUE_CLIP);
+    __m256i lo = _mm256_min_epi16(_mm256_max_epi16(_mm256_load_si256((const __m256i *)acc), zero), clip);
+    __m256i hi = _mm256_min_epi16(_mm256_max_epi16(_mm256_load_si256((const __m256i *)(acc + 16)), zero), clip);
+    /* packus interleaves 128-bit lanes; the permute restores element order */
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+}
+
+__attribute__((target("avx2")))
+static int32_t output_avx2(const int16_t *us, const int16_t *them, const int8_t *w) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < NNUE_HIDDEN; i += 32) {
+        /* u8 x s8 pairs fit int16: 2 * 127 * 128 < 32768 */
+        __m256i p = _mm256_maddubs_epi16(clip_pack(us + i),
+                                         _mm256_loadu_si256((const __m256i *)(w + i)));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(p, ones));
+        p = _mm256_maddubs_epi16(clip_pack(them + i),
+                                 _mm256_loadu_si256((const __m256i *)(w + NNUE_HIDDEN + i)));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(p, ones));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+}
+#endif /* NNUE_X86 */
+
+static void select_kernels(void) {
+    acc_add = acc_add_scalar;
+    acc_sub = acc_sub_scalar;
+    output = output_scalar;
+    kernel_name = "scalar";
+#ifdef NNUE_X86
+    if (getenv("CHESS_NNUE_SCALAR") == NULL && __builtin_cpu_supports("avx2")) {
+        acc_add = acc_add_avx2;
+        acc_sub = acc_sub_avx2;
+        output = output_avx2;
+        kernel_name = "avx2";
+    }
+#endif
+}
+
+/* Point the weight tables into a buffer laid out like the binary file */
+static void bind_image(const unsigned char *buf) {
+    image = buf;
+    b1 = (const int16_t *)(buf + B1_OFFSET);
+    w1 = (const int16_t *)(buf + W1_OFFSET);
+    w2 = (const int8_t *)(buf + W2_OFFSET);
+    memcpy(&b2, buf + B2_OFFSET, sizeof(b2));
+}
+
+/* Next integer token, skipping whitespace and '#' comments */
+static int next_int(char **p, long *out) {
+    while (**p) {
+        if (**p == '#') {
+            while (**p && **p != '\n') (*p)++;
+        } else if (**p == ' ' || **p == '\t' || **p == '\n' || **p == '\r') {
+            (*p)++;
+        } else {
+            char *end;
+            *out = strtol(*p, &end, 10);
+            if (end == *p) return 0;
+            *p = end;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Parse the text format into a freshly allocated binary image */
+static unsigned char *parse_text(char *text) {
+    char *p = text;
+    long v;
+    while (*p == '#' || *p == ' ' || *p == '\n') {
+        if (*p == '#') while (*p && *p != '\n') p++;
+        else p++;
+    }
+    if (strncmp(p, "nnue", 4) != 0) return NULL;
+    p += 4;
+    if (!next_int(&p, &v) || v != NNUE_HIDDEN) {
+        fprintf(stderr, "nnue: text net must have %d hidden units\n", NNUE_HIDDEN);
+        return NULL;
+    }
+    unsigned char *buf = aligned_alloc(64, (FILE_SIZE + 63) & ~63);
+    if (!buf) return NULL;
+    memset(buf, 0, HEADER_SIZE);
+    memcpy(buf, NNUE_MAGIC, sizeof(NNUE_MAGIC));
+    uint32_t hidden = NNUE_HIDDEN;
+    memcpy(buf + 8, &hidden, sizeof(hidden));
+
+    int16_t *i16 = (int16_t *)(buf + B1_OFFSET);
+    for (int i = 0; i < NNUE_HIDDEN + NNUE_INPUTS * NNUE_HIDDEN; i++) {
+        if (!next_int(&p, &v) || v < INT16_MIN || v > INT16_MAX) goto bad;
+        i16[i] = (int16_t)v;
+    }
+    int8_t *i8 = (int8_t *)(buf + W2_OFFSET);
+    for (int i = 0; i < 2 * NNUE_HIDDEN; i++) {
+        if (!next_int(&p, &v) || v < INT8_MIN || v > INT8_MAX) goto bad;
+        i8[i] = (int8_t)v;
+    }
+    if (!next_int(&p, &v)) goto bad;
+    int32_t bias = (int32_t)v;
+    memcpy(buf + B2_OFFSET, &bias, sizeof(bias));
+    return buf;
+bad:
+    fprintf(stderr, "nnue: truncated or out-of-range value in text net\n");
+    free(buf);
+    return NULL;
+}
+
+int nnue_load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < 8) {
+        fprintf(stderr, "nnue: %s is not a network file\n", path);
+        close(fd);
+        return 0;
+    }
+    unsigned char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    if (memcmp(map, NNUE_MAGIC, sizeof(NNUE_MAGIC)) == 0) {
+        uint32_t hidden;
+        memcpy(&hidden, map + 8, sizeof(hidden));
+        if (st.st_size != FILE_SIZE || hidden != NNUE_HIDDEN) {
+            fprintf(stderr, "nnue: %s has the wrong size or shape\n", path);
+            munmap(map, st.st_size);
+            return 0;
+        }
+        madvise(map, st.st_size, MADV_WILLNEED);
+        bind_image(map);    /* stays mapped for the life of the process */
+    } else {
+        /* Text format: copy out of the mapping to NUL-terminate it */
+        char *text = malloc(st.st_size + 1);
+        unsigned char *buf = NULL;
+        if (text) {
+            memcpy(text, map, st.st_size);
+            text[st.st_size] = '\0';
+            buf = parse_text(text);
+            free(text);
+        }
+        munmap(map, st.st_size);
+        if (!buf) {
+            fprintf(stderr, "nnue: cannot parse %s\n", path);
+            return 0;
+        }
+        bind_image(buf);
+    }
+    select_kernels();
+    loaded = 1;
+    return 1;
+}
+
+int nnue_loaded(void) {
+    return loaded;
+}
+
+const char *nnue_kernel_name(void) {
+    return kernel_name;
+}
+
+int nnue_save_binary(const char *path) {
+    if (!loaded) return 0;
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    int ok = fwrite(image, 1, FILE_SIZE, f) == FILE_SIZE;
+    if (fclose(f) != 0) ok = 0;
+    return ok;
+}
+
+/* Input index of a piece as seen by 'perspective'; Black's view is mirrored */
+static int feature(int perspective, char pc, int r, int c) {
+    static const char types[] = "pnbrqk";
+    int color = (pc >= 'A' && pc <= 'Z') ? WHITE : BLACK;
+    int type = (int)(strchr(types, pc | 0x20) - types);
+    int sq = (perspective == WHITE) ? r * 8 + c : (BOARD_SIZE - 1 - r) * 8 + c;
+    return ((color == perspective ? 0 : 6) + type) * 64 + sq;
+}
+
+void nnue_refresh(const GameState *game, NnueAccumulator *acc) {
+    for (int p = 0; p < 2; p++) {
+        memcpy(acc->v[p], b1, sizeof(acc->v[p]));
+        for (int r = 0; r < BOARD_SIZE; r++) {
+            for (int c = 0; c < BOARD_SIZE; c++) {
+                char pc = game->board[r][c];
+                if (pc != '.')
+                    acc_add(acc->v[p], w1 + feature(p, pc, r, c) * NNUE_HIDDEN);
+            }
+        }
+    }
+}
+
+/* A move changes at most four squares (castling), so this touches a
+   handful of weight rows instead of every piece on the board */
+void nnue_update(const GameState *parent, const GameState *child,
+                 const NnueAccumulator *parent_acc, NnueAccumulator *child_acc) {
+    if (child_acc != parent_acc) memcpy(child_acc, parent_acc, sizeof(*child_acc));
+    for (int r = 0; r < BOARD_SIZE; r++) {
+        if (memcmp(parent->board[r], child->board[r], BOARD_SIZE) == 0) continue;
+        for (int c = 0; c < BOARD_SIZE; c++) {
+            char before = parent->board[r][c], after = child->board[r][c];
+            if (before == after) continue;
+            for (int p = 0; p < 2; p++) {
+                if (before != '.') acc_sub(child_acc->v[p], w1 + feature(p, before, r, c) * NNUE_HIDDEN);
+                if (after != '.') acc_add(child_acc->v[p], w1 + feature(p, after, r, c) * NNUE_HIDDEN);
+            }
+        }
+    }
+}
+
+int nnue_evaluate(const GameState *game, const NnueAccumulator *acc) {
+    int us = game->turn;
+    int32_t sum = output(acc->v[us], acc->v[1 - us], w2) + b2;
+    return sum / (1 << NNUE_OUTPUT_SHIFT);
+}
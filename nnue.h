@@ -0,0 +1,55 @@
+/* nnue.h: Quantized neural evaluation with incrementally updated accumulators */
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <stdint.h>
+#include "chess.h"
+
+/* Network shape: 768 inputs (own/enemy x 6 piece types x 64 squares, seen
+   from each side) -> NNUE_HIDDEN int16 accumulator per side -> clipped ReLU
+   -> int8 output weights -> one score. */
+#define NNUE_INPUTS 768
+#define NNUE_HIDDEN 128
+#define NNUE_CLIP 127           /* clipped ReLU ceiling */
+#define NNUE_OUTPUT_SHIFT 6     /* output sum >> shift = centipawns */
+
+/* Binary file layout (little endian), mapped read-only at load time:
+     char    magic[8] = "CHNNUE1\0"
+     uint32  hidden   = NNUE_HIDDEN
+     uint32  reserved
+     int16   b1[NNUE_HIDDEN]
+     int16   w1[NNUE_INPUTS][NNUE_HIDDEN]
+     int8    w2[2 * NNUE_HIDDEN]        side to move first, then the other side
+     int32   b2
+   Text format (for tests): the line "nnue <hidden>" followed by the same
+   values in the same order as whitespace-separated integers; '#' starts a comment. */
+#define NNUE_MAGIC "CHNNUE1"
+
+/* First-layer outputs for both perspectives, indexed by color */
+typedef struct {
+    int16_t v[2][NNUE_HIDDEN] __attribute__((aligned(32)));
+} NnueAccumulator;
+
+/* Load a network (binary via mmap, or text). Returns 1 on success. */
+int nnue_load(const char *path);
+int nnue_loaded(void);
+
+/* Name of the kernel set in use: "avx2" when the CPU supports it, else
+   "scalar". Setting CHESS_NNUE_SCALAR in the environment forces scalar. */
+const char *nnue_kernel_name(void);
+
+/* Write the current network in binary format. Returns 1 on success. */
+int nnue_save_binary(const char *path);
+
+/* Compute an accumulator from scratch */
+void nnue_refresh(const GameState *game, NnueAccumulator *acc);
+
+/* Derive the child's accumulator from its parent's by applying only the
+   pieces removed and added between the two boards */
+void nnue_update(const GameState *parent, const GameState *child,
+                 const NnueAccumulator *parent_acc, NnueAccumulator *child_acc);
+
+/* Score from the side to move, in centipawns */
+int nnue_evaluate(const GameState *game, const NnueAccumulator *acc);
+
+#endif /* NNUE_H */
@@ -0,0 +1,135 @@
+/* nnuebench.c: Tools for the neural evaluation: generate a test network,
+ * convert text to binary, and benchmark evaluations per second.
+ *
+ *   nnuebench gen <out.txt> [seed]      random network in the text format
+ *   nnuebench convert <in> <out.bin>    write a loaded network as binary
+ *   nnuebench bench <net> [rounds]      incremental vs full-refresh evals/sec
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chess.h"
+#include "nnue.h"
+
+#define BENCH_PAIRS 4096    /* parent/child positions replayed per round */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int gen_net(const char *path, unsigned seed) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    srand(seed);
+    fprintf(f, "nnue %d\n# b1\n", NNUE_HIDDEN);
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+        fprintf(f, "%d%c", rand() % 32, (i % 16 == 15) ? '\n' : ' ');
+    fprintf(f, "# w1\n");
+    for (int i = 0; i < NNUE_INPUTS * NNUE_HIDDEN; i++)
+        fprintf(f, "%d%c", rand() % 17 - 8, (i % 16 == 15) ? '\n' : ' ');
+    fprintf(f, "# w2\n");
+    for (int i = 0; i < 2 * NNUE_HIDDEN; i++)
+        fprintf(f, "%d%c", rand() % 41 - 20, (i % 16 == 15) ? '\n' : ' ');
+    fprintf(f, "# b2\n0\n");
+    return fclose(f) == 0 ? 0 : 1;
+}
+
+/* Collect parent/child pairs from random games */
+static void random_pairs(GameState *parents, GameState *children, int count) {
+    GameState game;
+    Move moves[MAX_MOVES];
+    int i = 0;
+    srand(12345);
+    init_board(&game);
+    while (i < count) {
+        int n = generate_moves(&game, moves);
+        if (n == 0) {
+            init_board(&game);
+            continue;
+        }
+        Move m = moves[rand() % n];
+        parents[i] = game;
+        make_move(&game, m.src_row, m.src_col, m.dst_row, m.dst_col);
+        children[i++] = game;
+        if (i % 120 == 0) init_board(&game);  /* keep a mix of game phases */
+    }
+}
+
+static int bench(const char *path, int rounds) {
+    if (!nnue_load(path)) return 1;
+    GameState *parents = malloc(BENCH_PAIRS * sizeof(GameState));
+    GameState *children = malloc(BENCH_PAIRS * sizeof(GameState));
+    NnueAccumulator *accs = aligned_alloc(32, BENCH_PAIRS * sizeof(NnueAccumulator));
+    NnueAccumulator child_acc, full;
+    if (!parents || !children || !accs) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    random_pairs(parents, children, BENCH_PAIRS);
+    for (int i = 0; i < BENCH_PAIRS; i++) nnue_refresh(&parents[i], &accs[i]);
+
+    /* Incremental updates must match a full refresh exactly */
+    for (int i = 0; i < BENCH_PAIRS; i++) {
+        nnue_update(&parents[i], &children[i], &accs[i], &child_acc);
+        nnue_refresh(&children[i], &full);
+        if (memcmp(&child_acc, &full, sizeof(full)) != 0) {
+            fprintf(stderr, "Incremental update mismatch at pair %d.\n", i);
+            return 1;
+        }
+    }
+
+    long long evals = (long long)rounds * BENCH_PAIRS;
+    volatile int sink = 0;
+    double t0 = now_sec();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < BENCH_PAIRS; i++) {
+            nnue_update(&parents[i], &children[i], &accs[i], &child_acc);
+            sink += nnue_evaluate(&children[i], &child_acc);
+        }
+    }
+    double t_inc = now_sec() - t0;
+
+    t0 = now_sec();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < BENCH_PAIRS; i++) {
+            nnue_refresh(&children[i], &full);
+            sink += nnue_evaluate(&children[i], &full);
+        }
+    }
+    double t_full = now_sec() - t0;
+
+    printf("kernels: %s\n", nnue_kernel_name());
+    printf("incremental: %lld evals in %.3f s = %.0f evals/sec\n", evals, t_inc, evals / t_inc);
+    printf("refresh:     %lld evals in %.3f s = %.0f evals/sec\n", evals, t_full, evals / t_full);
+    free(parents);
+    free(children);
+    free(accs);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s gen <out.txt> [seed]\n"
+                    "       %s convert <in> <out.bin>\n"
+                    "       %s bench <net> [rounds]\n", prog, prog, prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) usage(argv[0]);
+    if (strcmp(argv[1], "gen") == 0)
+        return gen_net(argv[2], argc > 3 ? (unsigned)atoi(argv[3]) : 1);
+    if (strcmp(argv[1], "convert") == 0 && argc == 4) {
+        if (!nnue_load(argv[2]) || !nnue_save_binary(argv[3])) return 1;
+        return 0;
+    }
+    if (strcmp(argv[1], "bench") == 0)
+        return bench(argv[2], argc > 3 ? atoi(argv[3]) : 100);
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,217 @@
+/* outq.c: Per-connection outbound queues drained by dedicated writer threads.
+ *
+ * Game threads publish frames here instead of calling send(), so a slow
+ * or stalled peer costs its own writer thread time, never the game lock.
+ * The ring is lock-free: the producer owns 'tail', the writer owns
+ * 'head', and each publishes its index with release ordering. The
+ * writer sends every frame it finds queued in one sendmsg().
+ */
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include "outq.h"
+#include "trace.h"
+
+#define OUTQ_BATCH 16               /* frames gathered per sendmsg */
+#define OUTQ_SEND_TIMEOUT 30        /* seconds a blocked send may take */
+#define OUTQ_STACK_SIZE (64 * 1024) /* writers only sit in sendmsg */
+
+/* Process-wide totals. Per-frame counters stay in their queue, where
+   only one thread writes them, and are folded in when it closes;
+   outq_report adds in the open queues from 'open_queues'. */
+static struct {
+    size_t open, closed;
+    size_t enqueued, dropped, sent, bytes, writes;
+    size_t overflows, send_errors;
+    unsigned high_water;
+} totals;
+static OutQueue *open_queues;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Bump a counter owned by the calling thread so a reader sees whole values */
+static inline void count(size_t *counter, size_t n) {
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+static inline size_t peek(const size_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void count_failure(size_t *counter) {
+    pthread_mutex_lock(&totals_lock);
+    (*counter)++;
+    pthread_mutex_unlock(&totals_lock);
+}
+
+/* Send 'n' frames starting at 'head', resuming after partial writes */
+static int send_frames(OutQueue *q, unsigned head, unsigned n) {
+    struct iovec iov[OUTQ_BATCH];
+    struct msghdr msg;
+    size_t total = 0;
+    for (unsigned i = 0; i < n; i++) {
+        Frame *f = q->slots[(head + i) & (OUTQ_DEPTH - 1)];
+        iov[i].iov_base = f->data;
+        iov[i].iov_len = f->len;
+        total += f->len;
+    }
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n;
+    trace_event('B', "send", (int32_t)total);
+    while (msg.msg_iovlen > 0) {
+        ssize_t w = sendmsg(q->sock, &msg, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            trace_end("send");
+            return -1;
+        }
+        count(&q->writes, 1);
+        while (msg.msg_iovlen > 0 && (size_t)w >= msg.msg_iov->iov_len) {
+            w -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + w;
+            msg.msg_iov->iov_len -= w;
+        }
+    }
+    count(&q->bytes, total);
+    trace_end("send");
+    return 0;
+}
+
+static void *writer_thread(void *arg) {
+    OutQueue *q = arg;
+    unsigned head = q->head;
+    while (1) {
+        if (sem_wait(&q->ready) < 0) continue;   /* EINTR */
+        unsigned tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (__atomic_load_n(&q->closing, __ATOMIC_ACQUIRE)) break;
+            continue;   /* token for a frame already sent in an earlier batch */
+        }
+        unsigned n = tail - head;
+        if (n > OUTQ_BATCH) n = OUTQ_BATCH;
+        if (__atomic_load_n(&q->failed, __ATOMIC_RELAXED)) {
+            /* Cut off: just return the frames */
+        } else if (send_frames(q, head, n) == 0) {
+            count(&q->sent, n);
+        } else {
+            /* Peer gone or stuck past the send timeout: drop from now on */
+            __atomic_store_n(&q->failed, 1, __ATOMIC_RELAXED);
+            shutdown(q->sock, SHUT_RDWR);
+            count_failure(&totals.send_errors);
+        }
+        for (unsigned i = 0; i < n; i++)
+            pool_free(q->frames, q->slots[(head + i) & (OUTQ_DEPTH - 1)]);
+        head += n;
+        __atomic_store_n(&q->head, head, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+int outq_start(OutQueue *q, int sock, Pool *frames) {
+    memset(q, 0, sizeof(*q));
+    q->sock = sock;
+    q->frames = frames;
+    if (sem_init(&q->ready, 0, 0) < 0) return -1;
+
+    /* Bound how long a peer that stopped reading can hold its writer */
+    struct timeval tv = { OUTQ_SEND_TIMEOUT, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, OUTQ_STACK_SIZE);
+    int err = pthread_create(&q->writer, &attr, writer_thread, q);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        sem_destroy(&q->ready);
+        return -1;
+    }
+    pthread_mutex_lock(&totals_lock);
+    totals.open++;
+    q->next = open_queues;
+    if (open_queues) open_queues->prev = q;
+    open_queues = q;
+    pthread_mutex_unlock(&totals_lock);
+    return 0;
+}
+
+int outq_push(OutQueue *q, Frame *f) {
+    unsigned tail = q->tail;
+    unsigned head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&q->failed, __ATOMIC_RELAXED)) {
+        pool_free(q->frames, f);
+        count(&q->dropped, 1);
+        return -1;
+    }
+    if (tail - head == OUTQ_DEPTH) {
+        /* The peer is not reading. Cut it off rather than block the game;
+           its client thread sees the connection drop and ends the game. */
+        __atomic_store_n(&q->failed, 1, __ATOMIC_RELAXED);
+        shutdown(q->sock, SHUT_RDWR);
+        count_failure(&totals.overflows);
+        trace_instant("outq_overflow", q->sock);
+        pool_free(q->frames, f);
+        count(&q->dropped, 1);
+        return -1;
+    }
+    q->slots[tail & (OUTQ_DEPTH - 1)] = f;
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    sem_post(&q->ready);
+    count(&q->enqueued, 1);
+    if (tail + 1 - head > q->high_water)
+        __atomic_store_n(&q->high_water, tail + 1 - head, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void outq_close(OutQueue *q) {
+    __atomic_store_n(&q->closing, 1, __ATOMIC_RELEASE);
+    sem_post(&q->ready);
+    pthread_join(q->writer, NULL);
+    sem_destroy(&q->ready);
+
+    pthread_mutex_lock(&totals_lock);
+    if (q->prev) q->prev->next = q->next;
+    else open_queues = q->next;
+    if (q->next) q->next->prev = q->prev;
+    totals.open--;
+    totals.closed++;
+    totals.enqueued += q->enqueued;
+    totals.dropped += q->dropped;
+    totals.sent += q->sent;
+    totals.bytes += q->bytes;
+    totals.writes += q->writes;
+    if (q->high_water > totals.high_water) totals.high_water = q->high_water;
+    pthread_mutex_unlock(&totals_lock);
+}
+
+void outq_report(FILE *out) {
+    pthread_mutex_lock(&totals_lock);
+    size_t enqueued = totals.enqueued, dropped = totals.dropped, sent = totals.sent;
+    size_t bytes = totals.bytes, writes = totals.writes;
+    unsigned high_water = totals.high_water, depth = 0, max_depth = 0;
+    for (OutQueue *q = open_queues; q; q = q->next) {
+        enqueued += peek(&q->enqueued);
+        dropped += peek(&q->dropped);
+        sent += peek(&q->sent);
+        bytes += peek(&q->bytes);
+        writes += peek(&q->writes);
+        unsigned hw = __atomic_load_n(&q->high_water, __ATOMIC_RELAXED);
+        if (hw > high_water) high_water = hw;
+        unsigned d = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) -
+                     __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        depth += d;
+        if (d > max_depth) max_depth = d;
+    }
+    fprintf(out, "outq open %zu  closed %zu  queued %zu  dropped %zu  sent %zu  "
+            "writes %zu  bytes %zu  depth now %u (max %u)  peak depth %u/%d  "
+            "overflows %zu  send errors %zu\n",
+            totals.open, totals.closed, enqueued, dropped, sent, writes, bytes,
+            depth, max_depth, high_water, OUTQ_DEPTH, totals.overflows, totals.send_errors);
+    pthread_mutex_unlock(&totals_lock);
+}
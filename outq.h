@@ -0,0 +1,63 @@
+/* outq.h: Per-connection outbound queues drained by dedicated writer threads */
+#ifndef OUTQ_H
+#define OUTQ_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "pool.h"
+
+#define FRAME_SIZE 2048         /* fits a rendered board */
+#define OUTQ_DEPTH 64           /* frames in flight per connection; power of two */
+
+/* Outbound message frame */
+typedef struct {
+    size_t len;
+    char data[FRAME_SIZE];
+} Frame;
+
+/* Bounded single-producer/single-consumer ring of frames for one socket.
+   The producer never blocks: a peer that lets OUTQ_DEPTH frames pile up
+   is cut off instead. The writer sends and returns frames to 'frames'.
+   Each counter has a single writing thread and is read live by outq_report. */
+typedef struct OutQueue {
+    int sock;
+    Pool *frames;
+    pthread_t writer;
+    sem_t ready;                /* one post per pushed frame, plus one to close */
+    int closing;
+    int failed;                 /* peer cut off or send failed; frames are dropped */
+    struct OutQueue *prev, *next;   /* open queues, for outq_report */
+
+    /* Producer side */
+    unsigned tail;
+    size_t enqueued;
+    size_t dropped;
+    unsigned high_water;
+    char pad[64];               /* keep the two sides on separate cache lines */
+
+    /* Writer side */
+    unsigned head;
+    size_t sent;
+    size_t bytes;
+    size_t writes;              /* sendmsg calls; sent / writes is the batching */
+
+    Frame *slots[OUTQ_DEPTH];
+} OutQueue;
+
+/* Start the writer for 'sock'. Returns 0 on success, -1 if the thread
+   cannot be created. */
+int outq_start(OutQueue *q, int sock, Pool *frames);
+
+/* Queue a frame; the queue owns it from here on, even when it is dropped.
+   Only one thread may push at a time. Returns 0 if queued, -1 if dropped. */
+int outq_push(OutQueue *q, Frame *f);
+
+/* Let the writer drain what is queued, then join it. The socket stays open. */
+void outq_close(OutQueue *q);
+
+/* Print totals over every queue, open or closed, and the current depth */
+void outq_report(FILE *out);
+
+#endif /* OUTQ_H */
@@ -0,0 +1,205 @@
+/* pool.c: Slab-backed object pools with per-thread free lists.
+ *
+ * A thread that keeps allocating from a pool gets a small free list for
+ * it and only touches the pool's mutex to move a couple of objects to or
+ * from the shared depot. Threads that allocate once (a connection's
+ * receive buffer) or only free (writer threads returning frames) go to
+ * the depot directly, so server threads never sit on idle objects.
+ * Free lists of exiting threads are flushed back to the depot.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pool.h"
+
+#define POOL_ALIGN 64       /* keep objects on separate cache lines */
+#define POOL_CACHE 4        /* most objects a thread keeps per pool */
+#define POOL_BATCH (POOL_CACHE / 2) /* objects moved per depot transfer */
+#define SLAB_OBJECTS 64     /* minimum objects per slab */
+
+typedef struct FreeObj {
+    struct FreeObj *next;
+} FreeObj;
+
+struct Pool {
+    int id;
+    const char *name;
+    size_t obj_size;
+    pthread_mutex_t lock;   /* guards everything below */
+    FreeObj *depot;
+    size_t depot_count;
+    size_t capacity;
+    size_t peak_held;
+    size_t slabs;
+};
+
+/* One thread's free lists, one per pool */
+typedef struct {
+    FreeObj *head[POOL_MAX];
+    size_t count[POOL_MAX];
+    unsigned char allocs[POOL_MAX];     /* saturating; caching starts at 2 */
+    int registered;                     /* destructor armed */
+} ThreadCache;
+
+static Pool *pools[POOL_MAX];
+static int pool_count;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t cache_key;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static __thread ThreadCache thread_cache;
+
+/* Move 'n' objects from a thread list to the depot. Caller holds pool->lock. */
+static void depot_put(Pool *pool, FreeObj **head, size_t *count, size_t n) {
+    while (n-- > 0 && *head) {
+        FreeObj *obj = *head;
+        *head = obj->next;
+        obj->next = pool->depot;
+        pool->depot = obj;
+        pool->depot_count++;
+        (*count)--;
+    }
+}
+
+static void cache_destroy(void *arg) {
+    ThreadCache *tc = arg;
+    for (int i = 0; i < pool_count; i++) {
+        if (!tc->count[i]) continue;
+        Pool *pool = pools[i];
+        pthread_mutex_lock(&pool->lock);
+        depot_put(pool, &tc->head[i], &tc->count[i], tc->count[i]);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void cache_key_init(void) {
+    pthread_key_create(&cache_key, cache_destroy);
+}
+
+/* Arm the exit flush the first time a thread caches anything */
+static void cache_register(ThreadCache *tc) {
+    pthread_once(&cache_once, cache_key_init);
+    pthread_setspecific(cache_key, tc);
+    tc->registered = 1;
+}
+
+/* Carve a new slab into the depot. Caller holds pool->lock. */
+static int grow(Pool *pool, size_t objects) {
+    if (objects < SLAB_OBJECTS) objects = SLAB_OBJECTS;
+    char *slab;
+    if (posix_memalign((void **)&slab, POOL_ALIGN, objects * pool->obj_size) != 0)
+        return 0;
+    for (size_t i = 0; i < objects; i++) {
+        FreeObj *obj = (FreeObj *)(slab + i * pool->obj_size);
+        obj->next = pool->depot;
+        pool->depot = obj;
+    }
+    pool->depot_count += objects;
+    pool->capacity += objects;
+    pool->slabs++;
+    return 1;
+}
+
+Pool *pool_create(const char *name, size_t obj_size, size_t prealloc) {
+    Pool *pool = calloc(1, sizeof(Pool));
+    if (!pool) return NULL;
+    if (obj_size < sizeof(FreeObj)) obj_size = sizeof(FreeObj);
+    pool->obj_size = (obj_size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+    pool->name = name;
+    pthread_mutex_init(&pool->lock, NULL);
+    if (prealloc > 0 && !grow(pool, prealloc)) {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    if (pool_count == POOL_MAX) {
+        pthread_mutex_unlock(&registry_lock);
+        free(pool);
+        return NULL;
+    }
+    pool->id = pool_count;
+    pools[pool_count++] = pool;
+    pthread_mutex_unlock(&registry_lock);
+    return pool;
+}
+
+void *pool_alloc(Pool *pool) {
+    ThreadCache *tc = &thread_cache;
+    int id = pool->id;
+    FreeObj *obj = tc->head[id];
+    if (obj) {
+        tc->head[id] = obj->next;
+        tc->count[id]--;
+        return obj;
+    }
+    /* Take one object for this call, plus a batch for later once the
+       thread has shown it allocates from this pool repeatedly */
+    int batch = (tc->allocs[id] >= 1) ? POOL_BATCH : 1;
+    if (tc->allocs[id] < 2) tc->allocs[id]++;
+    pthread_mutex_lock(&pool->lock);
+    if (!pool->depot && !grow(pool, pool->capacity / 2)) {
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+    obj = pool->depot;
+    pool->depot = obj->next;
+    pool->depot_count--;
+    for (int n = 1; n < batch && pool->depot; n++) {
+        FreeObj *extra = pool->depot;
+        pool->depot = extra->next;
+        pool->depot_count--;
+        extra->next = tc->head[id];
+        tc->head[id] = extra;
+        tc->count[id]++;
+    }
+    size_t held = pool->capacity - pool->depot_count;
+    if (held > pool->peak_held) pool->peak_held = held;
+    pthread_mutex_unlock(&pool->lock);
+    if (tc->count[id] && !tc->registered) cache_register(tc);
+    return obj;
+}
+
+void pool_free(Pool *pool, void *ptr) {
+    if (!ptr) return;
+    ThreadCache *tc = &thread_cache;
+    FreeObj *obj = ptr;
+    int id = pool->id;
+    if (tc->allocs[id] < 2) {
+        /* Not an allocating thread for this pool: nothing to cache for */
+        pthread_mutex_lock(&pool->lock);
+        obj->next = pool->depot;
+        pool->depot = obj;
+        pool->depot_count++;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    obj->next = tc->head[id];
+    tc->head[id] = obj;
+    if (!tc->registered) cache_register(tc);
+    /* Keep at most POOL_CACHE locally; hand a batch back when over */
+    if (++tc->count[id] > POOL_CACHE) {
+        pthread_mutex_lock(&pool->lock);
+        depot_put(pool, &tc->head[id], &tc->count[id], POOL_BATCH);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void pool_stats(Pool *pool, PoolStats *stats) {
+    pthread_mutex_lock(&pool->lock);
+    stats->name = pool->name;
+    stats->obj_size = pool->obj_size;
+    stats->capacity = pool->capacity;
+    stats->held = pool->capacity - pool->depot_count;
+    stats->peak_held = pool->peak_held;
+    stats->slabs = pool->slabs;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_report(FILE *out) {
+    for (int i = 0; i < pool_count; i++) {
+        PoolStats st;
+        pool_stats(pools[i], &st);
+        fprintf(out, "pool %-10s size %5zu  held %6zu / %6zu  peak %6zu  slabs %zu\n",
+                st.name, st.obj_size, st.held, st.capacity, st.peak_held, st.slabs);
+    }
+}
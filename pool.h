@@ -0,0 +1,42 @@
+/* pool.h: Fixed-size object pools with per-thread free lists */
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Maximum number of pools per process */
+#define POOL_MAX 8
+
+typedef struct Pool Pool;
+
+/* Occupancy snapshot. 'held' counts objects out of the shared depot,
+   i.e. in use or parked in some thread's free list. */
+typedef struct {
+    const char *name;
+    size_t obj_size;
+    size_t capacity;    /* objects carved from slabs so far */
+    size_t held;
+    size_t peak_held;
+    size_t slabs;
+} PoolStats;
+
+/* Create a pool of 'obj_size' objects with 'prealloc' of them carved up front.
+   Returns NULL if out of memory or POOL_MAX pools already exist. */
+Pool *pool_create(const char *name, size_t obj_size, size_t prealloc);
+
+/* Take an object from the calling thread's free list, or from the shared
+   depot (which grows by a slab when empty). A thread's second allocation
+   from a pool starts its free list for it. NULL if out of memory. */
+void *pool_alloc(Pool *pool);
+
+/* Return an object to the calling thread's free list if it has one for
+   this pool, otherwise to the depot; any thread may free */
+void pool_free(Pool *pool, void *obj);
+
+void pool_stats(Pool *pool, PoolStats *stats);
+
+/* Print stats for every pool, one line each */
+void pool_report(FILE *out);
+
+#endif /* POOL_H */
@@ -0,0 +1,288 @@
+/* search.c: Alpha-beta search over chess.c positions */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "search.h"
+#include "nnue.h"
+
+#define TT_EXACT 1
+#define TT_LOWER 2
+#define TT_UPPER 3
+
+/* Per-search state threaded through the recursion */
+typedef struct {
+    const SearchLimits *limits;
+    TransTable *tt;
+    long long nodes;
+    int aborted;
+    int use_nnue;
+    NnueAccumulator acc[MAX_PLY + 1];   /* one per ply, updated incrementally */
+} SearchState;
+
+/* Allocate the transposition table (power-of-two entry count) */
+int tt_init(TransTable *tt, size_t mb) {
+    size_t count = 1;
+    while(count * 2 * sizeof(TTEntry) <= mb * 1024 * 1024) count *= 2;
+    tt->entries = calloc(count, sizeof(TTEntry));
+    if(!tt->entries) return 0;
+    tt->mask = count - 1;
+    return 1;
+}
+
+void tt_clear(TransTable *tt) {
+    memset(tt->entries, 0, (tt->mask + 1) * sizeof(TTEntry));
+}
+
+void tt_free(TransTable *tt) {
+    free(tt->entries);
+    tt->entries = NULL;
+    tt->mask = 0;
+}
+
+/* Data layout: score(16) | depth(8) | flag(8) | move(16) */
+static int tt_probe(TransTable *tt, uint64_t key, int *score, int *depth, int *flag, uint16_t *move) {
+    if(!tt) return 0;
+    TTEntry *e = &tt->entries[key & tt->mask];
+    uint64_t data = e->data;
+    if((e->check ^ data) != key) return 0;
+    *score = (int16_t)(data & 0xFFFF);
+    *depth = (data >> 16) & 0xFF;
+    *flag = (data >> 24) & 0xFF;
+    *move = (data >> 32) & 0xFFFF;
+    return 1;
+}
+
+static void tt_store(TransTable *tt, uint64_t key, int score, int depth, int flag, uint16_t move) {
+    if(!tt) return;
+    TTEntry *e = &tt->entries[key & tt->mask];
+    uint64_t data = (uint64_t)(uint16_t)score | ((uint64_t)depth << 16) |
+                    ((uint64_t)flag << 24) | ((uint64_t)move << 32);
+    e->data = data;
+    e->check = key ^ data;
+}
+
+/* The table is shared across searches, so mate scores are stored as the
+   distance from the stored node rather than from the root that found them */
+static int score_to_tt(int score, int ply) {
+    if(score >= MATE_SCORE - MAX_PLY) return score + ply;
+    if(score <= -MATE_SCORE + MAX_PLY) return score - ply;
+    return score;
+}
+
+static int score_from_tt(int score, int ply) {
+    if(score >= MATE_SCORE - MAX_PLY) return score - ply;
+    if(score <= -MATE_SCORE + MAX_PLY) return score + ply;
+    return score;
+}
+
+/* Piece values indexed by lowercase letter */
+static int piece_value(char pc) {
+    switch(pc | 0x20) {
+        case 'p': return 100;
+        case 'n': return 320;
+        case 'b': return 330;
+        case 'r': return 500;
+        case 'q': return 900;
+        default:  return 0;
+    }
+}
+
+/* Small positional bonus: centralize minor pieces, push pawns */
+static int piece_square(char pc, int r, int c) {
+    int white = (pc >= 'A' && pc <= 'Z');
+    int rank = white ? (BOARD_SIZE - 1 - r) : r;  /* 0 = own back rank */
+    int center = 6 - (abs(2 * r - 7) + abs(2 * c - 7)) / 2;
+    switch(pc | 0x20) {
+        case 'p': return rank * 5 + ((c == 3 || c == 4) ? 5 : 0);
+        case 'n': return center * 5;
+        case 'b': return center * 3;
+        case 'q': return center;
+        case 'k': return rank == 0 ? 10 : -rank * 5;
+        default:  return 0;
+    }
+}
+
+/* Material plus piece-square evaluation from the side to move */
+int evaluate(const GameState *game) {
+    int score = 0;
+    for(int r=0; r<BOARD_SIZE; r++) {
+        for(int c=0; c<BOARD_SIZE; c++) {
+            char pc = game->board[r][c];
+            if(pc == '.') continue;
+            int v = piece_value(pc) + piece_square(pc, r, c);
+            score += (pc >= 'A' && pc <= 'Z') ? v : -v;
+        }
+    }
+    return game->turn == WHITE ? score : -score;
+}
+
+static int is_capture(const GameState *game, Move m) {
+    char pc = game->board[m.src_row][m.src_col];
+    if(game->board[m.dst_row][m.dst_col] != '.') return 1;
+    return (pc == 'P' || pc == 'p') && m.src_col != m.dst_col;
+}
+
+/* Order: hash move first, then captures by victim value, then quiet moves */
+static void order_moves(const GameState *game, Move *moves, int n, uint16_t hash_move) {
+    int keys[MAX_MOVES];
+    for(int i=0; i<n; i++) {
+        char victim = game->board[moves[i].dst_row][moves[i].dst_col];
+        if(hash_move && move_pack(moves[i]) == hash_move) keys[i] = 100000;
+        else if(victim != '.') keys[i] = 10000 + piece_value(victim) * 10 -
+                    piece_value(game->board[moves[i].src_row][moves[i].src_col]) / 10;
+        else keys[i] = 0;
+    }
+    /* Insertion sort: move lists are short */
+    for(int i=1; i<n; i++) {
+        Move m = moves[i]; int k = keys[i]; int j = i - 1;
+        while(j >= 0 && keys[j] < k) { moves[j+1] = moves[j]; keys[j+1] = keys[j]; j--; }
+        moves[j+1] = m; keys[j+1] = k;
+    }
+}
+
+static int check_abort(SearchState *st) {
+    if(st->aborted) return 1;
+    if(st->limits->nodes > 0 && st->nodes >= st->limits->nodes) st->aborted = 1;
+    else if(st->limits->stop && __atomic_load_n(st->limits->stop, __ATOMIC_RELAXED))
+        st->aborted = 1;    /* cheap: read-mostly line */
+    return st->aborted;
+}
+
+static void apply_move(const GameState *game, Move m, GameState *child) {
+    copy_game(game, child);
+    make_move(child, m.src_row, m.src_col, m.dst_row, m.dst_col);
+}
+
+/* Make a move during search, carrying the network accumulator to the child ply */
+static void search_move(SearchState *st, const GameState *game, Move m, GameState *child, int ply) {
+    apply_move(game, m, child);
+    if(st->use_nnue) nnue_update(game, child, &st->acc[ply], &st->acc[ply + 1]);
+}
+
+static int eval_node(SearchState *st, const GameState *game, int ply) {
+    return st->use_nnue ? nnue_evaluate(game, &st->acc[ply]) : evaluate(game);
+}
+
+/* Capture-only search to settle tactics at the horizon */
+static int quiesce(SearchState *st, const GameState *game, int alpha, int beta, int ply) {
+    st->nodes++;
+    if(check_abort(st)) return 0;
+    int stand = eval_node(st, game, ply);
+    if(stand >= beta || ply >= MAX_PLY) return stand;
+    if(stand > alpha) alpha = stand;
+
+    Move moves[MAX_MOVES];
+    int n = generate_moves(game, moves);
+    order_moves(game, moves, n, 0);
+    for(int i=0; i<n; i++) {
+        if(!is_capture(game, moves[i])) break;  /* captures sort first */
+        GameState child;
+        search_move(st, game, moves[i], &child, ply);
+        int score = -quiesce(st, &child, -beta, -alpha, ply + 1);
+        if(st->aborted) return 0;
+        if(score >= beta) return score;
+        if(score > alpha) alpha = score;
+    }
+    return alpha;
+}
+
+static int negamax(SearchState *st, const GameState *game, int depth, int alpha, int beta,
+                   int ply, Move *best_out) {
+    if(depth <= 0 || ply >= MAX_PLY) return quiesce(st, game, alpha, beta, ply);
+    st->nodes++;
+    if(check_abort(st)) return 0;
+
+    uint64_t key = position_hash(game);
+    int tt_score, tt_depth, tt_flag;
+    uint16_t hash_move = 0;
+    if(tt_probe(st->tt, key, &tt_score, &tt_depth, &tt_flag, &hash_move) && ply > 0 &&
+       tt_depth >= depth) {
+        tt_score = score_from_tt(tt_score, ply);
+        if(tt_flag == TT_EXACT ||
+           (tt_flag == TT_LOWER && tt_score >= beta) ||
+           (tt_flag == TT_UPPER && tt_score <= alpha))
+            return tt_score;
+    }
+
+    Move moves[MAX_MOVES];
+    int n = generate_moves(game, moves);
+    if(n == 0)
+        return is_in_check(game, game->turn) ? -MATE_SCORE + ply : 0;
+    order_moves(game, moves, n, hash_move);
+
+    int orig_alpha = alpha;
+    int best = -MATE_SCORE - 1;
+    Move best_move = moves[0];
+    for(int i=0; i<n; i++) {
+        GameState child;
+        search_move(st, game, moves[i], &child, ply);
+        int score = -negamax(st, &child, depth - 1, -beta, -alpha, ply + 1, NULL);
+        if(st->aborted) return 0;
+        if(score > best) { best = score; best_move = moves[i]; }
+        if(score > alpha) alpha = score;
+        if(alpha >= beta) break;
+    }
+
+    int flag = best <= orig_alpha ? TT_UPPER : (best >= beta ? TT_LOWER : TT_EXACT);
+    tt_store(st->tt, key, score_to_tt(best, ply), depth, flag, move_pack(best_move));
+    if(best_out) *best_out = best_move;
+    return best;
+}
+
+/* Look up the stored best reply after 'm' to offer as a ponder move */
+static int find_ponder(TransTable *tt, const GameState *game, Move m, Move *out) {
+    GameState child;
+    int score, depth, flag;
+    uint16_t packed;
+    apply_move(game, m, &child);
+    if(!tt_probe(tt, position_hash(&child), &score, &depth, &flag, &packed) || !packed)
+        return 0;
+    Move moves[MAX_MOVES];
+    int n = generate_moves(&child, moves);
+    for(int i=0; i<n; i++) {
+        if(move_pack(moves[i]) == packed) { *out = moves[i]; return 1; }
+    }
+    return 0;
+}
+
+void search_position(const GameState *game, const SearchLimits *limits,
+                     TransTable *tt, SearchResult *result) {
+    SearchState *st = NULL;
+    /* Accumulators need 32-byte alignment for the vector kernels */
+    if(posix_memalign((void **)&st, 32, sizeof(SearchState)) != 0) st = NULL;
+    int max_depth = (limits->depth > 0 && limits->depth < MAX_PLY) ? limits->depth : MAX_PLY;
+    Move moves[MAX_MOVES];
+    int n = generate_moves(game, moves);
+
+    memset(result, 0, sizeof(*result));
+    if(n == 0 || !st) {
+        result->score = n ? evaluate(game) : (is_in_check(game, game->turn) ? -MATE_SCORE : 0);
+        result->has_move = n > 0;
+        if(n) result->best = moves[0];
+        free(st);
+        return;
+    }
+    st->limits = limits;
+    st->tt = tt;
+    st->nodes = 0;
+    st->aborted = 0;
+    st->use_nnue = nnue_loaded();
+    if(st->use_nnue) nnue_refresh(game, &st->acc[0]);
+    result->has_move = 1;
+    result->best = moves[0];
+    result->score = eval_node(st, game, 0);
+
+    for(int depth = 1; depth <= max_depth; depth++) {
+        Move best;
+        int score = negamax(st, game, depth, -MATE_SCORE - 1, MATE_SCORE + 1, 0, &best);
+        if(st->aborted) break;
+        result->best = best;
+        result->score = score;
+        result->depth = depth;
+        /* A forced mate will not get any better with more depth */
+        if(score >= MATE_SCORE - MAX_PLY || score <= -MATE_SCORE + MAX_PLY) break;
+    }
+    result->nodes = st->nodes;
+    free(st);
+    if(tt) result->has_ponder = find_ponder(tt, game, result->best, &result->ponder);
+}
@@ -0,0 +1,55 @@
+/* search.h: Declarations for the alpha-beta position search */
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdint.h>
+#include "chess.h"
+
+/* Scores are centipawns from the side to move; mates are near +-MATE_SCORE */
+#define MATE_SCORE 30000
+#define MAX_PLY 64
+
+/* Shared transposition table. Entries are written without locks: each slot
+   stores key ^ data so torn writes from concurrent searches are detected. */
+typedef struct {
+    uint64_t check;
+    uint64_t data;
+} TTEntry;
+
+typedef struct {
+    TTEntry *entries;
+    size_t mask;
+} TransTable;
+
+/* Limits for one search. depth <= 0 means MAX_PLY, nodes <= 0 means unbounded.
+   'stop' may point to a flag another thread sets (with an atomic store)
+   to abort the search. */
+typedef struct {
+    int depth;
+    long long nodes;
+    int *stop;
+} SearchLimits;
+
+typedef struct {
+    int score;          /* from the side to move */
+    int depth;          /* last fully completed iteration */
+    long long nodes;
+    int has_move;       /* 0 if the position is mate or stalemate */
+    Move best;
+    Move ponder;        /* expected reply, valid if has_ponder */
+    int has_ponder;
+} SearchResult;
+
+/* Allocate a table of roughly 'mb' megabytes. Returns 1 on success. */
+int tt_init(TransTable *tt, size_t mb);
+void tt_clear(TransTable *tt);
+void tt_free(TransTable *tt);
+
+/* Static evaluation from the side to move */
+int evaluate(const GameState *game);
+
+/* Iterative-deepening alpha-beta search; 'tt' may be NULL */
+void search_position(const GameState *game, const SearchLimits *limits,
+                     TransTable *tt, SearchResult *result);
+
+#endif /* SEARCH_H */
@@ -3,48 +3,120 @@
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <poll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include "chess.h"
-#include <locale.h>
+#include "pool.h"
+#include "search.h"
+#include "nnue.h"
+#include "engine.h"
+#include "gamedb.h"
+#include "trace.h"
+#include "outq.h"
 
 
-#define PORT 5000
+#define DEFAULT_PORT 5000
 #define BUF_SIZE 256
+#define DEFAULT_PREALLOC_GAMES 64
+#define DEFAULT_ENGINE_DEPTH 4
+#define DEFAULT_HASH_MB 32
+#define PAIR_WAIT_MS 50         /* a worker's lone player waits this long before the parent pairs it */
 
-int client_sock[2];     /* client sockets for WHITE=0, BLACK=1 */
-GameState game;         /* Shared game state */
-
-pthread_mutex_t game_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t turn_cond = PTHREAD_COND_INITIALIZER;
+typedef struct GameSession GameSession;
 
 /* Thread data */
 typedef struct {
+    GameSession *session;
     int color;         /* 0 for White, 1 for Black */
 } ThreadData;
 
-/* Send a message to a client */
-void send_msg(int sock, const char *msg) {
-    send(sock, msg, strlen(msg), 0);
+/* One game between two connected players */
+struct GameSession {
+    GameState game;             /* Shared game state */
+    int client_sock[2];         /* client sockets for WHITE=0, BLACK=1 */
+    pthread_mutex_t game_mutex;
+    pthread_cond_t turn_cond;
+    int threads_left;           /* last client thread out frees the session */
+    ThreadData td[2];
+    int vs_engine;              /* engine plays Black; client_sock[BLACK] is -1 */
+    Engine engine;
+    OutQueue outq[2];           /* pushed only under game_mutex, so one producer each */
+};
+
+/* Pools for sessions, per-connection receive buffers and outbound frames */
+static Pool *session_pool, *buf_pool, *frame_pool;
+
+/* Engine mode (-e): every player gets a game against the engine, which
+   shares one hash table per process across its games */
+static int engine_mode;
+static int engine_depth = DEFAULT_ENGINE_DEPTH;
+static long long ponder_all_nodes;
+static long hash_mb = DEFAULT_HASH_MB;
+static TransTable engine_tt;
+
+/* Directory for trace dumps written on SIGUSR2 (-t) */
+static const char *trace_dir = ".";
+
+/* Game store (-d) answering the "db" command; read-only, mapped per process */
+static const char *game_db_dir;
+static GameDB *game_db;
+
+/* Take the game lock, tracing both the wait and the hold */
+static void lock_game(GameSession *s) {
+    trace_begin("lock_wait");
+    pthread_mutex_lock(&s->game_mutex);
+    trace_end("lock_wait");
+    trace_begin("game_mutex");
 }
-static void broadcast_line(const char *line) {
-    for (int i = 0; i < 2; i++) {
-        send(client_sock[i], line, strlen(line), 0);
-    }
+
+static void unlock_game(GameSession *s) {
+    trace_end("game_mutex");
+    pthread_mutex_unlock(&s->game_mutex);
+}
+
+/* Queue a message for a client's writer. Caller holds game_mutex. */
+static void send_msg(GameSession *s, int color, const char *msg) {
+    if (s->client_sock[color] < 0) return;  /* engine side */
+    Frame *f = pool_alloc(frame_pool);
+    if (!f) return;
+    f->len = strlen(msg);
+    if (f->len > FRAME_SIZE) f->len = FRAME_SIZE;
+    memcpy(f->data, msg, f->len);
+    outq_push(&s->outq[color], f);
+}
+
+static void frame_append(Frame *f, const char *line) {
+    size_t len = strlen(line);
+    if (len > FRAME_SIZE - f->len) len = FRAME_SIZE - f->len;
+    memcpy(f->data + f->len, line, len);
+    f->len += len;
 }
 
-void broadcast_board() {
-    setlocale(LC_ALL, "");
+/* Render the board into one frame; no lock needed on a private copy */
+static Frame *render_board(const GameState *game) {
+    Frame *f = pool_alloc(frame_pool);
+    if (!f) return NULL;
+    trace_begin("render_board");
+    f->len = 0;
 
     // 파일 헤더 (열 이름) — 공백 3칸
-    broadcast_line("     a   b   c   d   e   f   g   h\n");
-    broadcast_line("   ╔═══╦═══╦═══╦═══╦═══╦═══╦═══╦═══╗\n");
+    frame_append(f, "     a   b   c   d   e   f   g   h\n");
+    frame_append(f, "   ╔═══╦═══╦═══╦═══╦═══╦═══╦═══╦═══╗\n");
 
     for (int r = 0; r < BOARD_SIZE; r++) {
         char line[BUF_SIZE] = {0};
         int off = snprintf(line, sizeof(line), " %d ║", BOARD_SIZE - r);
 
         for (int c = 0; c < BOARD_SIZE; c++) {
-            char pc = game.board[r][c];
+            char pc = game->board[r][c];
             const char *sym = " ";
             switch (pc) {
                 case 'K': sym = "♔"; break;
@@ -65,187 +137,754 @@ void broadcast_board() {
         }
 
         off += snprintf(line + off, sizeof(line) - off, " %d\n", BOARD_SIZE - r);
-        broadcast_line(line);
+        frame_append(f, line);
 
         if (r < BOARD_SIZE - 1)
-            broadcast_line("   ╠═══╬═══╬═══╬═══╬═══╬═══╬═══╬═══╣\n");
+            frame_append(f, "   ╠═══╬═══╬═══╬═══╬═══╬═══╬═══╬═══╣\n");
         else
-            broadcast_line("   ╚═══╩═══╩═══╩═══╩═══╩═══╩═══╩═══╝\n");
+            frame_append(f, "   ╚═══╩═══╩═══╩═══╩═══╩═══╩═══╩═══╝\n");
     }
 
     // 파일 푸터 (열 이름) — 공백 3칸
-    broadcast_line("     a   b   c   d   e   f   g   h\n");
+    frame_append(f, "     a   b   c   d   e   f   g   h\n");
+
+    trace_end("render_board");
+    return f;
+}
+
+/* Queue a rendered board for both players, taking ownership of 'board'.
+   Caller holds game_mutex. */
+static void broadcast_board(GameSession *s, Frame *board) {
+    if (!board) return;
+    if (s->client_sock[BLACK] >= 0) {
+        Frame *copy = pool_alloc(frame_pool);
+        if (copy) {
+            copy->len = board->len;
+            memcpy(copy->data, board->data, board->len);
+            outq_push(&s->outq[BLACK], copy);
+        }
+    }
+    outq_push(&s->outq[WHITE], board);
 }
 
-/* Handle a client (White or Black) */
+/* Play the engine's reply, then ponder on the player's time.
+   The search, the move and the board rendering all work on a copy;
+   game_mutex only covers installing the result and queueing replies. */
+static void engine_turn(GameSession *s) {
+    GameState pos;
+    SearchResult res;
+    char msg[BUF_SIZE], mv[5];
+
+    lock_game(s);
+    copy_game(&s->game, &pos);
+    unlock_game(s);
+
+    trace_begin("engine_think");
+    int has_move = engine_think(&s->engine, &pos, &res);
+    trace_end("engine_think");
+    if (!has_move) {
+        lock_game(s);
+        if (is_in_check(&pos, BLACK))
+            send_msg(s, WHITE, "Checkmate! WHITE wins.\n");
+        else
+            send_msg(s, WHITE, "Stalemate! Game is a draw.\n");
+        s->game.turn = -1;
+        unlock_game(s);
+        return;
+    }
+
+    trace_begin("make_move");
+    make_move(&pos, res.best.src_row, res.best.src_col, res.best.dst_row, res.best.dst_col);
+    trace_end("make_move");
+    pos.turn = WHITE;
+    format_move(res.best, mv);
+    if (res.has_ponder) {
+        char reply[5];
+        format_move(res.ponder, reply);
+        snprintf(msg, sizeof(msg), "Engine plays %s (expects %s).\n", mv, reply);
+    } else {
+        snprintf(msg, sizeof(msg), "Engine plays %s.\n", mv);
+    }
+    Frame *board = render_board(&pos);
+
+    lock_game(s);
+    copy_game(&pos, &s->game);
+    send_msg(s, WHITE, msg);
+    broadcast_board(s, board);
+    unlock_game(s);
+
+    engine_ponder_start(&s->engine, &pos, &res);
+}
+
+/* Tell a player which stored games reached the current position */
+static void send_db_summary(GameSession *s, int color) {
+    GameState pos;
+    GameSummary sum;
+    char msg[BUF_SIZE];
+
+    lock_game(s);
+    copy_game(&s->game, &pos);
+    unlock_game(s);
+
+    trace_begin("gamedb_query");
+    gamedb_query(game_db, &pos, NULL, 0, &sum);
+    trace_end("gamedb_query");
+    snprintf(msg, sizeof(msg), "Position reached in %zu games: %zu white wins, %zu draws, "
+             "%zu black wins, %zu unfinished.\n",
+             sum.games, sum.white_wins, sum.draws, sum.black_wins, sum.unknown);
+    lock_game(s);
+    send_msg(s, color, msg);
+    unlock_game(s);
+}
+
+/* Stop the writers, close the sockets and return the session to its pool.
+   Called by whichever thread leaves the game last. */
+static void free_session(GameSession *s) {
+    for (int i = 0; i < 2; i++) {
+        if (s->client_sock[i] < 0) continue;
+        outq_close(&s->outq[i]);
+        close(s->client_sock[i]);
+    }
+    if (s->vs_engine) engine_destroy(&s->engine);
+    pthread_mutex_destroy(&s->game_mutex);
+    pthread_cond_destroy(&s->turn_cond);
+    pool_free(session_pool, s);
+}
+
+/* Handle a client (White or Black).
+   Everything sent goes through the writers' queues, so game_mutex is
+   never held across network I/O. While it is our turn only this thread
+   changes the game, so the position is checked, moved and rendered on a
+   private copy and the lock covers just installing it and the turn switch. */
 void *client_thread(void *arg) {
     ThreadData *td = (ThreadData*)arg;
+    GameSession *s = td->session;
     int me = td->color;
     int other = 1 - me;
-    char buf[BUF_SIZE];
-
-    /* Assign color */
-    if (me == WHITE) {
-        send_msg(client_sock[me], "You are WHITE. Waiting for Black...\n");
-    } else {
-        send_msg(client_sock[me], "You are BLACK. Starting game...\n");
+    int *client_sock = s->client_sock;
+    GameState pos, next;
+    char *buf = pool_alloc(buf_pool);
+    if (!buf) {
+        /* No buffer: leave like a disconnected player */
+        lock_game(s);
+        send_msg(s, other, "Opponent disconnected. Game over.\n");
+        s->game.turn = -1;
+        pthread_cond_signal(&s->turn_cond);
+        unlock_game(s);
+        goto game_end;
     }
 
-    /* Wait for both clients ready */
-    if (me == BLACK) {
-        /* When Black connects, broadcast initial board */
-        broadcast_board();
+    /* Assign color; when Black connects (or the engine game starts),
+       broadcast the initial board */
+    lock_game(s);
+    if (s->vs_engine) {
+        send_msg(s, me, "You are WHITE. Playing against the engine.\n");
+        broadcast_board(s, render_board(&s->game));
+    } else if (me == WHITE) {
+        send_msg(s, me, "You are WHITE. Waiting for Black...\n");
+    } else {
+        send_msg(s, me, "You are BLACK. Starting game...\n");
+        broadcast_board(s, render_board(&s->game));
     }
+    unlock_game(s);
 
     /* Game loop */
     while (1) {
-        pthread_mutex_lock(&game_mutex);
+        lock_game(s);
         /* Wait for our turn */
-        while (game.turn != me) {
-            if (game.turn == -1) {
-                pthread_mutex_unlock(&game_mutex);
+        while (s->game.turn != me) {
+            if (s->game.turn == -1) {
+                unlock_game(s);
                 goto game_end;
             }
-            pthread_cond_wait(&turn_cond, &game_mutex);
+            trace_end("game_mutex");
+            trace_begin("turn_wait");
+            pthread_cond_wait(&s->turn_cond, &s->game_mutex);
+            trace_end("turn_wait");
+            trace_begin("game_mutex");
         }
+        copy_game(&s->game, &pos);
+        unlock_game(s);
 
         /* Check for checkmate or stalemate */
-        if (is_in_check(&game, me)) {
-            if (!has_valid_moves(&game, me)) {
-                broadcast_board();
-                if (me == WHITE) {
-                    send_msg(client_sock[me], "Checkmate! BLACK wins.\n");
-                    send_msg(client_sock[other], "Checkmate! BLACK wins.\n");
-                } else {
-                    send_msg(client_sock[me], "Checkmate! WHITE wins.\n");
-                    send_msg(client_sock[other], "Checkmate! WHITE wins.\n");
-                }
-                game.turn = -1;
-                pthread_cond_signal(&turn_cond);
-                pthread_mutex_unlock(&game_mutex);
-                break;
-            }
-        } else {
-            if (!has_valid_moves(&game, me)) {
-                broadcast_board();
-                send_msg(client_sock[me], "Stalemate! Game is a draw.\n");
-                send_msg(client_sock[other], "Stalemate! Game is a draw.\n");
-                game.turn = -1;
-                pthread_cond_signal(&turn_cond);
-                pthread_mutex_unlock(&game_mutex);
-                break;
-            }
+        trace_begin("has_valid_moves");
+        int in_check = is_in_check(&pos, me);
+        int can_move = has_valid_moves(&pos, me);
+        trace_end("has_valid_moves");
+        if (!can_move) {
+            const char *result = !in_check ? "Stalemate! Game is a draw.\n" :
+                                 me == WHITE ? "Checkmate! BLACK wins.\n" :
+                                               "Checkmate! WHITE wins.\n";
+            Frame *board = render_board(&pos);
+            lock_game(s);
+            broadcast_board(s, board);
+            send_msg(s, me, result);
+            send_msg(s, other, result);
+            s->game.turn = -1;
+            pthread_cond_signal(&s->turn_cond);
+            unlock_game(s);
+            break;
         }
 
         /* Prompt for move */
-        send_msg(client_sock[me], "Your move: \n");
-        pthread_mutex_unlock(&game_mutex);
+        lock_game(s);
+        send_msg(s, me, "Your move: \n");
+        unlock_game(s);
 
         /* Read move from client */
-        ssize_t bytes_read = recv(client_sock[me], buf, sizeof(buf) - 1, 0);
+        trace_begin("recv");
+        ssize_t bytes_read = recv(client_sock[me], buf, BUF_SIZE - 1, 0);
+        trace_event('E', "recv", (int32_t)bytes_read);
+        if (bytes_read > 0)
+            buf[bytes_read] = '\0';
+        if (bytes_read > 0 && game_db && strncmp(buf, "db", 2) == 0 &&
+            buf[2 + strspn(buf + 2, "\r\n")] == '\0') {
+            /* Database lookup; pondering carries on, then prompt again */
+            send_db_summary(s, me);
+            continue;
+        }
         if (bytes_read <= 0) {
-            perror("recv");
-            exit(1);
+            /* Player left: end this game only */
+            lock_game(s);
+            send_msg(s, other, "Opponent disconnected. Game over.\n");
+            s->game.turn = -1;
+            pthread_cond_signal(&s->turn_cond);
+            unlock_game(s);
+            break;
         }
         buf[bytes_read] = '\0';
 
         /* Remove newline */
         buf[strcspn(buf, "\r\n")] = '\0';
 
-        pthread_mutex_lock(&game_mutex);
         int sr, sc, dr, dc;
+        const char *error = NULL;
         if (!parse_move(buf, &sr, &sc, &dr, &dc)) {
-            send_msg(client_sock[me], "Invalid input format. Use e2e4, etc.\n");
+            error = "Invalid input format. Use e2e4, etc.\n";
         } else {
-            if (!make_move(&game, sr, sc, dr, dc)) {
-                send_msg(client_sock[me], "Invalid move. Try again.\n");
-            } else {
-                /* Move applied, switch turn */
-                broadcast_board();
-                game.turn = other;
-                pthread_cond_signal(&turn_cond);
-            }
+            /* make_move may touch the position before rejecting a move */
+            copy_game(&pos, &next);
+            trace_begin("make_move");
+            if (!make_move(&next, sr, sc, dr, dc))
+                error = "Invalid move. Try again.\n";
+            trace_end("make_move");
+        }
+        if (error) {
+            lock_game(s);
+            send_msg(s, me, error);
+            unlock_game(s);
+            continue;
+        }
+        next.turn = other;
+        Frame *board = render_board(&next);
+
+        /* The move is in: cancel pondering before touching the game.
+           Bad input above leaves the engine thinking on the player's time. */
+        if (s->vs_engine) {
+            trace_begin("ponder_stop");
+            engine_ponder_stop(&s->engine);
+            trace_end("ponder_stop");
+        }
+
+        /* Move applied, switch turn */
+        lock_game(s);
+        int moved = (s->game.turn == me);   /* unless the game was torn down */
+        if (moved) {
+            copy_game(&next, &s->game);
+            broadcast_board(s, board);
+            pthread_cond_signal(&s->turn_cond);
+        } else if (board) {
+            pool_free(frame_pool, board);
         }
-        pthread_mutex_unlock(&game_mutex);
+        unlock_game(s);
+
+        if (moved && s->vs_engine)
+            engine_turn(s);
     }
 
 game_end:
+    lock_game(s);
+    int last = (--s->threads_left == 0);
+    unlock_game(s);
+    if (last) {
+        if (s->vs_engine)
+            printf("Game over (ponder hits %d, misses %d).\n",
+                   s->engine.ponder_hits, s->engine.ponder_misses);
+        else
+            printf("Game over.\n");
+        free_session(s);
+    }
+    pool_free(buf_pool, buf);
     return NULL;
 }
 
-/* Function to run serveo or localhost.run */
-void start_reverse_tunnel() {
-    printf("Starting reverse tunnel via serveo.net...\n");
-    // 비대화형, 백그라운드 실행
-    const char *cmd =
-      "ssh -o StrictHostKeyChecking=no "
-      "-o UserKnownHostsFile=/dev/null "
-      "-N "
-      "-R 0:localhost:5000 "
-      "serveo.net &";
-    int rc = system(cmd);
-    if (rc != 0) {
-        fprintf(stderr, "Failed to establish reverse tunnel (rc=%d).\n", rc);
-        exit(1);
+/* Launch a reverse SSH tunnel via serveo.net without waiting for it.
+   The ssh process is double-forked so it never needs reaping, and a
+   failure only means the server is not reachable through the tunnel. */
+void start_reverse_tunnel(int port) {
+    char spec[32];
+    snprintf(spec, sizeof(spec), "0:localhost:%d", port);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return;
     }
-    sleep(2);  // 터널 안정화 잠깐 대기
-    printf("Reverse tunnel launched in background.\n");
+    if (pid == 0) {
+        if (fork() == 0) {
+            // 비대화형, 백그라운드 실행
+            execlp("ssh", "ssh",
+                   "-o", "StrictHostKeyChecking=no",
+                   "-o", "UserKnownHostsFile=/dev/null",
+                   "-N", "-R", spec, "serveo.net", (char *)NULL);
+            fprintf(stderr, "Failed to launch reverse tunnel: %s\n", strerror(errno));
+            _exit(127);
+        }
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+    printf("Reverse tunnel launching in background via serveo.net.\n");
 }
 
-
-int main() {
-    int server_sock;
-    struct sockaddr_in serv_addr;
-    printf("Starting Chess server on port %d...\n", PORT);
-
-    /* Initialize game */
-    init_board(&game);
-
-    /* Run reverse SSH tunnel for public access */
-    start_reverse_tunnel();
-
-    /* Setup TCP socket */
-    if ((server_sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+/* Create a listening TCP socket; SO_REUSEPORT lets sibling workers share the port */
+static int open_listener(int port, int backlog, int reuseport) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
         perror("socket");
-        exit(1);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (reuseport && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(sock);
+        return -1;
     }
+    struct sockaddr_in serv_addr;
     memset(&serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(PORT);
+    serv_addr.sin_port = htons(port);
     serv_addr.sin_addr.s_addr = INADDR_ANY;
-    if (bind(server_sock, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
+    if (bind(sock, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
         perror("bind");
+        close(sock);
+        return -1;
+    }
+    if (listen(sock, backlog) < 0) {
+        perror("listen");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* Start a game for two connected players on its own pair of threads.
+   black_sock of -1 starts a game against the engine with one thread. */
+static void start_game(int white_sock, int black_sock) {
+    int players = (black_sock < 0) ? 1 : 2;
+    int one = 1;
+    /* Replies are small and latency-bound; do not let Nagle hold them */
+    setsockopt(white_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (black_sock >= 0)
+        setsockopt(black_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    GameSession *s = pool_alloc(session_pool);
+    if (!s) {
+        close(white_sock);
+        if (black_sock >= 0) close(black_sock);
+        return;
+    }
+    init_board(&s->game);
+    s->client_sock[WHITE] = white_sock;
+    s->client_sock[BLACK] = black_sock;
+    pthread_mutex_init(&s->game_mutex, NULL);
+    pthread_cond_init(&s->turn_cond, NULL);
+    s->threads_left = players;
+    s->vs_engine = (players == 1);
+    if (s->vs_engine)
+        engine_init(&s->engine, &engine_tt, engine_depth, ponder_all_nodes);
+    for (int i = 0; i < players; i++) {
+        if (outq_start(&s->outq[i], s->client_sock[i], frame_pool) < 0) {
+            fprintf(stderr, "Cannot start writer thread.\n");
+            /* Only the queues started so far get closed */
+            for (int k = i; k < 2; k++) {
+                if (s->client_sock[k] >= 0) close(s->client_sock[k]);
+                s->client_sock[k] = -1;
+            }
+            free_session(s);
+            return;
+        }
+    }
+
+    for (int i = 0; i < players; i++) {
+        ThreadData *td = &s->td[i];
+        pthread_t th;
+        td->session = s;
+        td->color = i;
+        if (pthread_create(&th, NULL, client_thread, td) != 0) {
+            /* Cannot run the game; make the started thread (if any) finish it */
+            perror("pthread_create");
+            /* Wake a started thread out of recv; its writer still sends */
+            shutdown(white_sock, SHUT_RD);
+            if (black_sock >= 0) shutdown(black_sock, SHUT_RD);
+            lock_game(s);
+            send_msg(s, 1 - i, "Server error. Game over.\n");
+            s->game.turn = -1;
+            int last = ((s->threads_left -= players - i) == 0);
+            pthread_cond_signal(&s->turn_cond);
+            unlock_game(s);
+            if (last)
+                free_session(s);
+            return;
+        }
+        pthread_detach(th);
+    }
+}
+
+/* SIGUSR1 prints pool occupancy and outbound queue totals; SIGUSR2 dumps the trace rings */
+static void *signal_thread(void *arg) {
+    sigset_t *set = arg;
+    int sig, dumps = 0;
+    while (sigwait(set, &sig) == 0) {
+        if (sig == SIGUSR1) {
+            printf("[%d] Pool stats:\n", (int)getpid());
+            pool_report(stdout);
+            outq_report(stdout);
+            fflush(stdout);
+        } else if (sig == SIGUSR2) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/chess-trace-%d-%d.json",
+                     trace_dir, (int)getpid(), dumps++);
+            long n = trace_dump(path);
+            if (n >= 0) printf("[%d] Wrote %ld trace events to %s\n", (int)getpid(), n, path);
+            fflush(stdout);
+        }
+    }
+    return NULL;
+}
+
+/* Per-process startup: preallocate pools and start the signal thread.
+   Called after fork so every worker owns its pools. */
+static void init_process(long prealloc_games) {
+    static sigset_t set;
+    session_pool = pool_create("session", sizeof(GameSession), prealloc_games);
+    buf_pool = pool_create("iobuf", BUF_SIZE, 2 * prealloc_games);
+    frame_pool = pool_create("frame", sizeof(Frame), 4 * prealloc_games);
+    if (!session_pool || !buf_pool || !frame_pool) {
+        fprintf(stderr, "Cannot preallocate pools.\n");
+        exit(1);
+    }
+    if (game_db_dir && !(game_db = gamedb_open(game_db_dir, 0)))
+        exit(1);
+    if (engine_mode && !tt_init(&engine_tt, hash_mb)) {
+        fprintf(stderr, "Cannot allocate %ld MB hash table.\n", hash_mb);
         exit(1);
     }
-    listen(server_sock, 2);
-    printf("Waiting for two players to connect...\n");
 
-    /* Accept two clients */
-    for (int i = 0; i < 2; i++) {
-        client_sock[i] = accept(server_sock, NULL, NULL);
-        if (client_sock[i] < 0) {
+    /* Block SIGUSR1/2 in every thread; only the signal thread takes them */
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    pthread_t th;
+    if (pthread_create(&th, NULL, signal_thread, &set) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+    pthread_detach(th);
+}
+
+/* Pair up incoming players into games, forever */
+static void serve(int server_sock) {
+    int waiting = -1;   /* White player waiting for an opponent */
+    while (1) {
+        trace_begin("accept");
+        int sock = accept(server_sock, NULL, NULL);
+        trace_end("accept");
+        if (sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
             perror("accept");
             exit(1);
         }
-        printf("Client %d connected.\n", i);
+        if (engine_mode) {
+            printf("[%d] Player connected, starting engine game.\n", (int)getpid());
+            start_game(sock, -1);
+        } else if (waiting < 0) {
+            waiting = sock;
+            printf("[%d] Player connected, waiting for opponent.\n", (int)getpid());
+        } else {
+            printf("[%d] Opponent connected, starting game.\n", (int)getpid());
+            start_game(waiting, sock);
+            waiting = -1;
+        }
     }
+}
 
-    /* Launch client threads */
-    pthread_t th[2];
-    ThreadData td[2];
-    for (int i = 0; i < 2; i++) {
-        td[i].color = i;
-        if (pthread_create(&th[i], NULL, client_thread, &td[i]) != 0) {
-            perror("pthread_create");
+/* CLOCK_MONOTONIC is system-wide, so workers' timestamps compare */
+static long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+/* Pass file descriptors over a Unix socket (SCM_RIGHTS) along with the
+   time the first was accepted. Returns 0 on success. */
+static int send_fds(int chan, const int *fds, int n, long accepted) {
+    struct iovec iov = { &accepted, sizeof(accepted) };
+    char ctrl[CMSG_SPACE(2 * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(ctrl, 0, sizeof(ctrl));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = CMSG_SPACE(n * sizeof(int));
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(n * sizeof(int));
+    memcpy(CMSG_DATA(cm), fds, n * sizeof(int));
+    return sendmsg(chan, &msg, MSG_NOSIGNAL) == sizeof(accepted) ? 0 : -1;
+}
+
+/* Receive up to 2 descriptors. Returns the count, 0 on EOF, -1 on error. */
+static int recv_fds(int chan, int *fds, long *accepted) {
+    struct iovec iov = { accepted, sizeof(*accepted) };
+    char ctrl[CMSG_SPACE(2 * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    ssize_t n = recvmsg(chan, &msg, 0);
+    if (n <= 0) return (int)n;
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (!cm || cm->cmsg_type != SCM_RIGHTS) return -1;
+    int count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(fds, CMSG_DATA(cm), count * sizeof(int));
+    return count;
+}
+
+/* Sharded worker: accept on its own SO_REUSEPORT listener and pair players
+   locally, so under load games start without leaving the process. The
+   kernel may route the two players of a game to different workers, so a
+   player still alone after PAIR_WAIT_MS goes to the parent; pairs it
+   makes come back on 'chan' and the game runs in this worker. */
+static void serve_worker(int server_sock, int chan) {
+    struct pollfd pfd[2] = { { server_sock, POLLIN, 0 }, { chan, POLLIN, 0 } };
+    int waiting = -1;   /* lone player accepted here */
+    long since = 0;
+    while (1) {
+        int timeout = -1;
+        if (waiting >= 0) {
+            long left = PAIR_WAIT_MS - (now_us() - since) / 1000;
+            if (left <= 0) {
+                if (send_fds(chan, &waiting, 1, since) < 0) perror("sendmsg");
+                close(waiting);
+                waiting = -1;
+            } else {
+                timeout = (int)left;
+            }
+        }
+        if (poll(pfd, 2, timeout) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            exit(1);
+        }
+        if (pfd[0].revents & POLLIN) {
+            int sock = accept(server_sock, NULL, NULL);
+            if (sock >= 0 && engine_mode) {
+                start_game(sock, -1);   /* no pairing needed */
+            } else if (sock >= 0 && waiting >= 0) {
+                printf("[%d] Starting game.\n", (int)getpid());
+                start_game(waiting, sock);
+                waiting = -1;
+            } else if (sock >= 0) {
+                waiting = sock;
+                since = now_us();
+            } else if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN) {
+                perror("accept");
+                exit(1);
+            }
+        }
+        if (pfd[1].revents & (POLLIN | POLLHUP)) {
+            int fds[2];
+            long accepted;
+            int n = recv_fds(chan, fds, &accepted);
+            if (n == 0) exit(0);    /* parent went away */
+            if (n == 2) {
+                printf("[%d] Starting game.\n", (int)getpid());
+                start_game(fds[0], fds[1]);
+            } else {
+                for (int i = 0; i < n; i++) close(fds[i]);
+            }
+        }
+    }
+}
+
+/* Parent of sharded workers: pair the players workers could not pair
+   themselves and send each pair to the worker that forwarded the second */
+static void matchmaker(int *chans, long workers) {
+    struct pollfd *pfd = calloc(workers, sizeof(struct pollfd));
+    long alive = workers;
+    int waiting = -1;
+    long waiting_since = 0;
+    if (!pfd) {
+        perror("calloc");
+        exit(1);
+    }
+    for (long i = 0; i < workers; i++) {
+        pfd[i].fd = chans[i];
+        pfd[i].events = POLLIN;
+    }
+    while (alive > 0) {
+        if (poll(pfd, workers, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
             exit(1);
         }
+        for (long i = 0; i < workers; i++) {
+            if (pfd[i].fd < 0 || !(pfd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            int fds[2];
+            long accepted;
+            int n = recv_fds(pfd[i].fd, fds, &accepted);
+            if (n <= 0) {
+                /* Worker died; its games are lost but the others carry on */
+                int status;
+                pid_t pid = wait(&status);
+                fprintf(stderr, "Worker %d exited (status %d).\n", (int)pid, status);
+                close(pfd[i].fd);
+                pfd[i].fd = -1;
+                alive--;
+                continue;
+            }
+            for (int k = 0; k < n; k++) {
+                if (waiting < 0) {
+                    waiting = fds[k];
+                    waiting_since = accepted;
+                    continue;
+                }
+                /* Workers forward after a wait, so arrival order here may
+                   differ; whoever was accepted first plays White */
+                int pair[2] = { waiting, fds[k] };
+                if (accepted < waiting_since) {
+                    pair[0] = fds[k];
+                    pair[1] = waiting;
+                }
+                if (send_fds(pfd[i].fd, pair, 2, 0) < 0) perror("sendmsg");
+                close(pair[0]);
+                close(pair[1]);
+                waiting = -1;
+            }
+        }
     }
+    free(pfd);
+}
 
-    /* Wait for threads to finish */
-    for (int i = 0; i < 2; i++) {
-        pthread_join(th[i], NULL);
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-p port] [-b backlog] [-w workers] [-g games] [-T]\n"
+                    "          [-e] [-D depth] [-A ponder_nodes] [-H hash_mb] [-d gamedb]\n"
+                    "          [-t trace_dir] [-n network]\n"
+                    "  -w 0 forks one worker per core, each with its own listener\n"
+                    "  -g   games to preallocate per worker (SIGUSR1 prints pool stats)\n"
+                    "  -t   directory for trace dumps written on SIGUSR2 (default .)\n"
+                    "  -T   do not launch the reverse SSH tunnel\n"
+                    "  -e   play every connected player against the engine, which ponders\n"
+                    "       the predicted reply (and, with -A, all replies) on their time\n"
+                    "  -d   game store for the \"db\" command (games reaching this position)\n"
+                    "  -n   neural network for the engine's evaluation (see nnuebench)\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int port = DEFAULT_PORT;
+    int backlog = SOMAXCONN;
+    long workers = 1;
+    long prealloc_games = DEFAULT_PREALLOC_GAMES;
+    int tunnel = 1;
+    const char *network = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:b:w:g:TeD:A:H:d:t:n:")) != -1) {
+        switch (opt) {
+            case 'p': port = atoi(optarg); break;
+            case 'b': backlog = atoi(optarg); break;
+            case 'w': workers = atol(optarg); break;
+            case 'g': prealloc_games = atol(optarg); break;
+            case 'T': tunnel = 0; break;
+            case 'e': engine_mode = 1; break;
+            case 'D': engine_depth = atoi(optarg); break;
+            case 'A': ponder_all_nodes = atoll(optarg); break;
+            case 'H': hash_mb = atol(optarg); break;
+            case 'd': game_db_dir = optarg; break;
+            case 't': trace_dir = optarg; break;
+            case 'n': network = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (port <= 0 || port > 65535 || backlog <= 0 || workers < 0 || prealloc_games < 0 ||
+        engine_depth < 1 || engine_depth >= MAX_PLY || hash_mb < 1) usage(argv[0]);
+    if (workers == 0) workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+
+    /* Load before forking so workers share the weights */
+    if (network) {
+        if (!nnue_load(network)) exit(1);
+        printf("Loaded network %s (%s kernels).\n", network, nnue_kernel_name());
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    printf("Starting Chess server on port %d with %ld worker(s)...\n", port, workers);
+
+    /* Run reverse SSH tunnel for public access; do not wait for it */
+    if (tunnel)
+        start_reverse_tunnel(port);
+
+    if (workers == 1) {
+        int server_sock = open_listener(port, backlog, 0);
+        if (server_sock < 0) exit(1);
+        init_process(prealloc_games);
+        printf("Waiting for players to connect...\n");
+        serve(server_sock);
+        close(server_sock);
+        return 0;
+    }
+
+    /* Each worker binds its own SO_REUSEPORT listener so the kernel spreads
+       connections across processes without a shared accept queue */
+    int *chans = calloc(workers, sizeof(int));
+    if (!chans) {
+        perror("calloc");
+        exit(1);
+    }
+    for (long i = 0; i < workers; i++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+            perror("socketpair");
+            exit(1);
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            for (long k = 0; k < i; k++) close(chans[k]);
+            close(sv[0]);
+            int server_sock = open_listener(port, backlog, 1);
+            if (server_sock < 0) _exit(1);
+            init_process(prealloc_games);
+            serve_worker(server_sock, sv[1]);
+            _exit(0);
+        }
+        close(sv[1]);
+        chans[i] = sv[0];
     }
-    printf("Game over. Server shutting down.\n");
-    close(server_sock);
+    printf("Waiting for players to connect...\n");
+    /* Stats and traces come from workers; survive a group signal */
+    signal(SIGUSR1, SIG_IGN);
+    signal(SIGUSR2, SIG_IGN);
+    matchmaker(chans, workers);
+    free(chans);
     return 0;
 }
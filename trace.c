@@ -0,0 +1,112 @@
+/* trace.c: Per-thread trace rings and Chrome trace export */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+__thread TraceRing *trace_ring;
+
+static TraceRing *rings;    /* push-only list */
+static pthread_key_t release_key;
+static pthread_once_t release_once = PTHREAD_ONCE_INIT;
+
+/* Thread exit: keep the events, let the next new thread take the ring */
+static void release_ring(void *arg) {
+    TraceRing *r = arg;
+    __atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void release_key_init(void) {
+    pthread_key_create(&release_key, release_ring);
+}
+
+TraceRing *trace_attach(void) {
+    TraceRing *r;
+    pthread_once(&release_once, release_key_init);
+
+    /* Reuse a ring from an exited thread first */
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&r->in_use, &expected, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+    if (!r) {
+        r = calloc(1, sizeof(TraceRing));
+        if (!r) return NULL;
+        r->in_use = 1;
+        r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+    r->tid = (uint32_t)syscall(SYS_gettid);
+    trace_ring = r;
+    pthread_setspecific(release_key, r);
+    return r;
+}
+
+/* Copy the readable part of a ring: events the owner cannot have
+   overwritten between the two reads of head */
+static size_t snapshot(TraceRing *r, TraceEvent *out) {
+    uint64_t end = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint64_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+    for (uint64_t i = begin; i < end; i++)
+        out[i - begin] = r->events[i & (TRACE_RING_SIZE - 1)];
+    /* Keep the copy above from being moved past the second read (seqlock) */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t now = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    /* Slots in [begin, now + 1 - size) may have been rewritten during the
+       copy; the last of them holds event 'now', which the owner may be
+       writing but has not published yet */
+    uint64_t safe = now + 1 > TRACE_RING_SIZE ? now + 1 - TRACE_RING_SIZE : 0;
+    if (safe <= begin) return end - begin;
+    if (safe >= end) return 0;
+    memmove(out, out + (safe - begin), (end - safe) * sizeof(TraceEvent));
+    return end - safe;
+}
+
+static void write_name(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+long trace_dump(const char *path) {
+    TraceEvent *buf = malloc(TRACE_RING_SIZE * sizeof(TraceEvent));
+    FILE *f = fopen(path, "w");
+    long written = 0;
+    int pid = (int)getpid();
+    if (!buf || !f) {
+        if (!f) perror(path);
+        free(buf);
+        if (f) fclose(f);
+        return -1;
+    }
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (TraceRing *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        size_t n = snapshot(r, buf);
+        for (size_t i = 0; i < n; i++) {
+            TraceEvent *e = &buf[i];
+            fprintf(f, "%s{\"name\":", written ? ",\n" : "");
+            write_name(f, e->name);
+            fprintf(f, ",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%u",
+                    e->phase, (unsigned long long)(e->ts / 1000),
+                    (unsigned long long)(e->ts % 1000), pid, e->tid);
+            if (e->phase == 'i') fprintf(f, ",\"s\":\"t\",\"args\":{\"value\":%d}", e->arg);
+            else if (e->arg) fprintf(f, ",\"args\":{\"value\":%d}", e->arg);
+            fputc('}', f);
+            written++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    free(buf);
+    if (fclose(f) != 0) return -1;
+    return written;
+}
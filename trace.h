@@ -0,0 +1,61 @@
+/* trace.h: Always-on per-thread event tracing with Chrome trace export */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Events per thread ring; older events are overwritten */
+#define TRACE_RING_SIZE 4096
+
+typedef struct {
+    uint64_t ts;            /* CLOCK_MONOTONIC nanoseconds */
+    const char *name;       /* static string */
+    uint32_t tid;
+    int32_t arg;
+    char phase;             /* 'B' begin, 'E' end, 'i' instant */
+} TraceEvent;
+
+/* Written only by its owning thread; 'head' is published with release
+   ordering so a dumper can copy the ring without locks */
+typedef struct TraceRing {
+    uint64_t head;
+    uint32_t tid;
+    int in_use;             /* owned by a live thread */
+    struct TraceRing *next; /* registry of all rings */
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+extern __thread TraceRing *trace_ring;
+
+/* Give the calling thread a ring (reusing one left by an exited thread) */
+TraceRing *trace_attach(void);
+
+static inline void trace_event(char phase, const char *name, int32_t arg) {
+    TraceRing *r = trace_ring;
+    struct timespec ts;
+    if (!r && !(r = trace_attach())) return;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t head = r->head;
+    /* Order the previous head store before this slot's writes, so a
+       dumper that sees them also sees the head that makes them stale */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    TraceEvent *e = &r->events[head & (TRACE_RING_SIZE - 1)];
+    e->ts = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    e->name = name;
+    e->tid = r->tid;
+    e->arg = arg;
+    e->phase = phase;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#define trace_begin(name) trace_event('B', (name), 0)
+#define trace_end(name) trace_event('E', (name), 0)
+#define trace_instant(name, arg) trace_event('i', (name), (arg))
+
+/* Write every ring to 'path' as Chrome trace JSON (chrome://tracing,
+   Perfetto). Safe to call while other threads keep tracing. Returns the
+   number of events written, or -1 on error. */
+long trace_dump(const char *path);
+
+#endif /* TRACE_H */